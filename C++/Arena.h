@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+// Scratch memory for the parse loops. Every thread owns a bump allocator; a ScratchScope marks its position
+// when a chunk starts and rewinds to it when the chunk is done, so the field spans, unescaped cells and decode
+// buffers of the next chunk reuse the same blocks. Once the blocks are large enough a scan runs without
+// touching the heap, which the counters below make visible.
+
+// Heap allocations of the calling thread. Only counted in programs that define ARENA_COUNT_HEAP before the
+// first include of this header, which replaces the global operator new.
+inline thread_local uint64_t heapAllocations = 0;
+
+#ifdef ARENA_COUNT_HEAP
+// none of them are inlined, or the compiler sees malloc() paired with a delete expression or the other way round
+__attribute__((noinline)) void* operator new(std::size_t size) {
+    ++heapAllocations;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+__attribute__((noinline)) void operator delete(void* p) noexcept { std::free(p); }
+__attribute__((noinline)) void operator delete[](void* p) noexcept { std::free(p); }
+__attribute__((noinline)) void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+__attribute__((noinline)) void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+#endif
+
+struct ArenaStats {
+    uint64_t allocations = 0; // requests served from the arena
+    uint64_t bytes = 0;       // bytes handed out
+    uint64_t blocks = 0;      // blocks taken from the heap
+};
+
+class Arena {
+public:
+    struct Mark {
+        size_t block;
+        size_t used;
+    };
+
+    explicit Arena(size_t blockSize = 64 << 10) : blockSize_(blockSize) {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena() {
+        for (Block& block : blocks_) ::operator delete(block.data);
+    }
+
+    void* allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+        ++stats_.allocations;
+        stats_.bytes += size;
+        while (true) {
+            if (current_ < blocks_.size()) {
+                size_t at = (used_ + align - 1) & ~(align - 1);
+                if (at + size <= blocks_[current_].size) {
+                    used_ = at + size;
+                    return blocks_[current_].data + at;
+                }
+                // blocks that are too small stay where they are for the next rewind
+                ++current_;
+                used_ = 0;
+                continue;
+            }
+            size_t bytes = std::max(blockSize_, size + align);
+            blocks_.push_back({static_cast<char*>(::operator new(bytes)), bytes});
+            ++stats_.blocks;
+        }
+    }
+
+    Mark mark() const { return {current_, used_}; }
+
+    // Free everything allocated after mark, the blocks are kept
+    void rewind(Mark mark) {
+        current_ = mark.block;
+        used_ = mark.used;
+    }
+
+    const ArenaStats& stats() const { return stats_; }
+
+private:
+    struct Block {
+        char* data;
+        size_t size;
+    };
+
+    size_t blockSize_;
+    std::vector<Block> blocks_;
+    size_t current_ = 0;
+    size_t used_ = 0;
+    ArenaStats stats_;
+};
+
+inline Arena& threadArena() {
+    thread_local Arena arena;
+    return arena;
+}
+
+// Standard allocator over an arena so containers can live in scratch memory; deallocate is a no-op and the
+// memory comes back when the scope rewinds. Without an arena it falls back to the heap.
+template <class T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    ArenaAllocator(Arena* arena = nullptr) noexcept : arena_(arena) {}
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena_(other.arena()) {}
+
+    T* allocate(size_t n) {
+        if (arena_) return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t) noexcept {
+        if (!arena_) ::operator delete(p);
+    }
+
+    Arena* arena() const noexcept { return arena_; }
+
+    template <class U>
+    bool operator==(const ArenaAllocator<U>& other) const noexcept { return arena_ == other.arena(); }
+    template <class U>
+    bool operator!=(const ArenaAllocator<U>& other) const noexcept { return arena_ != other.arena(); }
+
+private:
+    Arena* arena_;
+};
+
+// Totals over every thread, folded in whenever a ScratchScope closes
+struct AllocationTotals {
+    std::atomic<uint64_t> scopes{0};
+    std::atomic<uint64_t> arenaAllocations{0};
+    std::atomic<uint64_t> arenaBytes{0};
+    std::atomic<uint64_t> arenaBlocks{0};
+    std::atomic<uint64_t> heapAllocations{0}; // made while a scope was open, ARENA_COUNT_HEAP only
+    std::atomic<uint64_t> warmupAllocations{0}; // the part of them made in the first scope of each thread
+};
+
+inline AllocationTotals& allocationTotals() {
+    static AllocationTotals totals;
+    return totals;
+}
+
+// Scratch memory for one chunk. Containers built on arena() must be declared after the scope so they are gone
+// before it rewinds.
+class ScratchScope {
+public:
+    explicit ScratchScope(Arena& arena = threadArena())
+        : arena_(arena), mark_(arena.mark()), stats_(arena.stats()), heap_(heapAllocations) {}
+    ScratchScope(const ScratchScope&) = delete;
+    ScratchScope& operator=(const ScratchScope&) = delete;
+
+    ~ScratchScope() {
+        AllocationTotals& totals = allocationTotals();
+        const ArenaStats& now = arena_.stats();
+        totals.scopes.fetch_add(1, std::memory_order_relaxed);
+        totals.arenaAllocations.fetch_add(now.allocations - stats_.allocations, std::memory_order_relaxed);
+        totals.arenaBytes.fetch_add(now.bytes - stats_.bytes, std::memory_order_relaxed);
+        totals.arenaBlocks.fetch_add(now.blocks - stats_.blocks, std::memory_order_relaxed);
+        totals.heapAllocations.fetch_add(heapAllocations - heap_, std::memory_order_relaxed);
+        // the first chunk of a thread also sets up its thread-locals and grows its arena
+        thread_local bool warm = false;
+        if (!warm) totals.warmupAllocations.fetch_add(heapAllocations - heap_, std::memory_order_relaxed);
+        warm = true;
+        arena_.rewind(mark_);
+    }
+
+    Arena* arena() { return &arena_; }
+
+private:
+    Arena& arena_;
+    Arena::Mark mark_;
+    ArenaStats stats_;
+    uint64_t heap_;
+};
+
+// One line summary of allocationTotals() for --stats
+inline std::string allocationReport() {
+    const AllocationTotals& totals = allocationTotals();
+    return "Allocations: " + std::to_string(totals.heapAllocations.load()) + " heap allocations in " +
+           std::to_string(totals.scopes.load()) + " scanned chunks (" + std::to_string(totals.warmupAllocations.load()) +
+           " in the first chunk of each thread), " + std::to_string(totals.arenaAllocations.load()) +
+           " scratch allocations (" + std::to_string(totals.arenaBytes.load()) + " bytes) served from " +
+           std::to_string(totals.arenaBlocks.load()) + " arena blocks";
+}
@@ -0,0 +1,422 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "CsvTokenizer.h"
+#include "StageStats.h"
+
+// Streaming reader that overlaps disk reads with parsing. A reader thread keeps queueDepth large aligned
+// block reads in flight (io_uring, or a pool of pread threads where io_uring is unavailable), stitches the
+// completed blocks back together in file order on record boundaries and hands the record-aligned chunks to
+// parser threads through a bounded queue. Buffers go back to a free pool once a parser is done with them.
+
+enum class IoBackend { Uring, Pread };
+
+struct ReadOptions {
+    IoBackend backend = IoBackend::Uring;
+    size_t blockSize = 4 << 20;
+    size_t queueDepth = 8;
+    size_t headroom = 1 << 20; // room in front of each block for the partial record carried over from the last one
+};
+
+inline bool parseIoBackend(std::string_view name, IoBackend& backend) {
+    if (name == "uring") backend = IoBackend::Uring;
+    else if (name == "pread") backend = IoBackend::Pread;
+    else return false;
+    return true;
+}
+
+// Blocking multi-producer multi-consumer queue with a fixed capacity. pop() returns false once the queue was
+// closed and drained.
+template <class T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity_(capacity) {}
+
+    void push(T item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notFull_.wait(lock, [&] { return items_.size() < capacity_; });
+        items_.push_back(std::move(item));
+        notEmpty_.notify_one();
+    }
+
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notEmpty_.wait(lock, [&] { return !items_.empty() || closed_; });
+        if (items_.empty()) return false;
+        item = std::move(items_.front());
+        items_.pop_front();
+        notFull_.notify_one();
+        return true;
+    }
+
+    bool tryPop(T& item) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (items_.empty()) return false;
+        item = std::move(items_.front());
+        items_.pop_front();
+        notFull_.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        notEmpty_.notify_all();
+    }
+
+private:
+    size_t capacity_;
+    std::deque<T> items_;
+    bool closed_ = false;
+    std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+};
+
+struct ReadBuffer {
+    char* memory = nullptr; // headroom bytes followed by blockSize bytes, page aligned
+};
+
+// One block read; done counts the bytes that arrived so far so short reads can be resubmitted
+struct ReadRequest {
+    ReadBuffer* buffer = nullptr;
+    uint64_t offset = 0;
+    size_t length = 0;
+    size_t done = 0;
+};
+
+class IoQueue {
+public:
+    virtual ~IoQueue() = default;
+    virtual bool submit(ReadRequest* request) = 0;
+    // Block until one submission finishes; result is the byte count or -errno
+    virtual bool wait(ReadRequest*& request, int& result) = 0;
+};
+
+// Minimal io_uring driver on the raw syscalls, IORING_OP_READ into the buffer at the request's offset
+class UringQueue : public IoQueue {
+public:
+    UringQueue(int fd, size_t headroom) : fd_(fd), headroom_(headroom) {}
+
+    ~UringQueue() override {
+        if (sqes_) munmap(sqes_, sqesSize_);
+        if (cqRing_ && cqRing_ != sqRing_) munmap(cqRing_, cqRingSize_);
+        if (sqRing_) munmap(sqRing_, sqRingSize_);
+        if (ringFd_ >= 0) close(ringFd_);
+    }
+
+    bool init(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ringFd_ = int(syscall(__NR_io_uring_setup, entries, &params));
+        if (ringFd_ < 0) return false;
+        sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMmap) sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+        sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+        if (sqRing_ == MAP_FAILED) {
+            sqRing_ = nullptr;
+            return false;
+        }
+        cqRing_ = singleMmap ? sqRing_ : mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_CQ_RING);
+        if (cqRing_ == MAP_FAILED) {
+            cqRing_ = nullptr;
+            return false;
+        }
+        sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) return false;
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        char* sq = static_cast<char*>(sqRing_);
+        char* cq = static_cast<char*>(cqRing_);
+        sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    bool submit(ReadRequest* request) override {
+        unsigned tail = *sqTail_;
+        unsigned index = tail & sqMask_;
+        io_uring_sqe* sqe = &sqes_[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fd_;
+        sqe->addr = reinterpret_cast<uint64_t>(request->buffer->memory + headroom_ + request->done);
+        sqe->len = unsigned(request->length - request->done);
+        sqe->off = request->offset + request->done;
+        sqe->user_data = reinterpret_cast<uint64_t>(request);
+        sqArray_[index] = index;
+        __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+        return syscall(__NR_io_uring_enter, ringFd_, 1, 0, 0, nullptr, 0) >= 0;
+    }
+
+    bool wait(ReadRequest*& request, int& result) override {
+        while (true) {
+            unsigned head = *cqHead_;
+            if (head != __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+                io_uring_cqe* cqe = &cqes_[head & cqMask_];
+                request = reinterpret_cast<ReadRequest*>(cqe->user_data);
+                result = cqe->res;
+                __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+            if (syscall(__NR_io_uring_enter, ringFd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) {
+                return false;
+            }
+        }
+    }
+
+private:
+    int fd_;
+    size_t headroom_;
+    int ringFd_ = -1;
+    void* sqRing_ = nullptr;
+    void* cqRing_ = nullptr;
+    size_t sqRingSize_ = 0;
+    size_t cqRingSize_ = 0;
+    size_t sqesSize_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    unsigned* sqTail_ = nullptr;
+    unsigned sqMask_ = 0;
+    unsigned* sqArray_ = nullptr;
+    unsigned* cqHead_ = nullptr;
+    unsigned* cqTail_ = nullptr;
+    unsigned cqMask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+};
+
+// Fallback: queueDepth threads doing blocking pread()s
+class PreadQueue : public IoQueue {
+public:
+    PreadQueue(int fd, size_t headroom, size_t numThreads)
+        : fd_(fd), headroom_(headroom), submissions_(numThreads * 2), completions_(numThreads * 2) {
+        for (size_t i = 0; i < numThreads; ++i) {
+            threads_.emplace_back([this] {
+                ReadRequest* request;
+                while (submissions_.pop(request)) {
+                    ssize_t n = pread(fd_, request->buffer->memory + headroom_ + request->done,
+                                      request->length - request->done, off_t(request->offset + request->done));
+                    completions_.push({request, n < 0 ? -errno : int(n)});
+                }
+            });
+        }
+    }
+
+    ~PreadQueue() override {
+        submissions_.close();
+        for (auto& thread : threads_) thread.join();
+    }
+
+    bool submit(ReadRequest* request) override {
+        submissions_.push(request);
+        return true;
+    }
+
+    bool wait(ReadRequest*& request, int& result) override {
+        std::pair<ReadRequest*, int> completion;
+        if (!completions_.pop(completion)) return false;
+        request = completion.first;
+        result = completion.second;
+        return true;
+    }
+
+private:
+    int fd_;
+    size_t headroom_;
+    BoundedQueue<ReadRequest*> submissions_;
+    BoundedQueue<std::pair<ReadRequest*, int>> completions_;
+    std::vector<std::thread> threads_;
+};
+
+// Read path from offset to its end and call parse(chunk, chunkOffset) on numParsers threads, every chunk
+// holding whole records only. stop may be set by a parser to end the stream early. backendUsed reports "uring" or
+// "pread" (io_uring falls back to pread when the kernel refuses it).
+inline bool streamRecords(const std::string& path, char delimiter, uint64_t offset, const ReadOptions& options, size_t numParsers,
+                          const std::function<void(std::string_view, uint64_t)>& parse, const std::atomic<bool>* stop,
+                          std::string& backendUsed) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    uint64_t fileSize = uint64_t(st.st_size);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    std::unique_ptr<IoQueue> io;
+    if (options.backend == IoBackend::Uring) {
+        auto uring = std::make_unique<UringQueue>(fd, options.headroom);
+        if (uring->init(unsigned(options.queueDepth))) io = std::move(uring);
+    }
+    backendUsed = io ? "uring" : "pread";
+    if (!io) io = std::make_unique<PreadQueue>(fd, options.headroom, options.queueDepth);
+
+    // every buffer is either free, being read, waiting to be stitched or held by a parser
+    size_t bufferCount = options.queueDepth + numParsers * 2 + 2;
+    std::vector<ReadBuffer> buffers(bufferCount);
+    std::vector<ReadRequest> requests(bufferCount);
+    BoundedQueue<ReadBuffer*> freeBuffers(bufferCount);
+    bool ok = true;
+    for (ReadBuffer& buffer : buffers) {
+        void* memory = nullptr;
+        if (posix_memalign(&memory, 4096, options.headroom + options.blockSize) != 0) {
+            ok = false;
+            break;
+        }
+        buffer.memory = static_cast<char*>(memory);
+        freeBuffers.push(&buffer);
+    }
+
+    // a chunk either lives in a read buffer or, for records bigger than the headroom, in its own string
+    struct Chunk {
+        ReadBuffer* buffer = nullptr;
+        std::shared_ptr<std::string> overflow;
+        std::string_view text;
+        uint64_t offset = 0; // of text in the file
+    };
+    BoundedQueue<Chunk> chunks(numParsers * 2);
+    std::vector<std::thread> parsers;
+    for (size_t i = 0; ok && i < numParsers; ++i) {
+        parsers.emplace_back([&] {
+            Chunk chunk;
+            // waiting for the next block is the read stage of a parser thread
+            StageTimer timer;
+            while (chunks.pop(chunk)) {
+                timer.lap(Stage::Read);
+                parse(chunk.text, chunk.offset);
+                timer.skip();
+                if (chunk.buffer) freeBuffers.push(chunk.buffer);
+                chunk = Chunk();
+            }
+        });
+    }
+
+    CsvTokenizer tokenizer(delimiter);
+    std::string carry;
+    std::map<uint64_t, ReadRequest*> completed; // finished blocks waiting for an earlier one, by offset
+    uint64_t nextSubmit = offset;
+    uint64_t nextStitch = offset;
+    size_t inFlight = 0;
+    size_t nextRequest = 0;
+
+    // append one block to the carried-over partial record and pass on everything up to the last record end
+    auto stitch = [&](ReadRequest* request) {
+        char* data = request->buffer->memory + options.headroom;
+        bool lastBlock = request->offset + request->done >= fileSize || request->done < request->length;
+        Chunk chunk;
+        chunk.offset = request->offset - carry.size();
+        std::string_view text;
+        if (carry.size() <= options.headroom) {
+            std::memcpy(data - carry.size(), carry.data(), carry.size());
+            text = std::string_view(data - carry.size(), carry.size() + request->done);
+            chunk.buffer = request->buffer;
+        } else {
+            chunk.overflow = std::make_shared<std::string>(carry);
+            chunk.overflow->append(data, request->done);
+            text = *chunk.overflow;
+            freeBuffers.push(request->buffer);
+        }
+        size_t boundary = lastBlock ? text.size() : tokenizer.lastRecordEnd(text);
+        std::string nextCarry(text.substr(boundary));
+        if (boundary > 0) {
+            chunk.text = text.substr(0, boundary);
+            chunks.push(chunk);
+        } else if (chunk.buffer) {
+            freeBuffers.push(chunk.buffer);
+        }
+        carry.swap(nextCarry);
+    };
+
+    while (ok) {
+        while (inFlight < options.queueDepth && nextSubmit < fileSize && !(stop && stop->load())) {
+            ReadBuffer* buffer;
+            if (inFlight == 0 && completed.empty()) {
+                if (!freeBuffers.pop(buffer)) break;
+            } else if (!freeBuffers.tryPop(buffer)) {
+                break;
+            }
+            ReadRequest* request = &requests[nextRequest++ % requests.size()];
+            *request = ReadRequest{buffer, nextSubmit, size_t(std::min<uint64_t>(options.blockSize, fileSize - nextSubmit)), 0};
+            if (!io->submit(request)) {
+                ok = false;
+                break;
+            }
+            nextSubmit += request->length;
+            ++inFlight;
+        }
+        if (inFlight == 0) break;
+
+        ReadRequest* request;
+        int result;
+        if (!io->wait(request, result) || result < 0) {
+            ok = false;
+            break;
+        }
+        request->done += size_t(result);
+        if (result > 0 && request->done < request->length) {
+            // short read, ask for the rest
+            if (!io->submit(request)) ok = false;
+            continue;
+        }
+        --inFlight;
+        completed[request->offset] = request;
+        for (auto it = completed.find(nextStitch); it != completed.end(); it = completed.find(nextStitch)) {
+            ReadRequest* ready = it->second;
+            completed.erase(it);
+            nextStitch = ready->offset + ready->length;
+            stitch(ready);
+        }
+    }
+    if (ok && !carry.empty() && !(stop && stop->load())) {
+        Chunk chunk;
+        chunk.overflow = std::make_shared<std::string>(carry);
+        chunk.text = *chunk.overflow;
+        chunk.offset = nextStitch - carry.size();
+        chunks.push(chunk);
+    }
+
+    chunks.close();
+    for (auto& parser : parsers) parser.join();
+    // drain reads still in flight after a stop or an error before the buffers go away
+    while (inFlight > 0) {
+        ReadRequest* request;
+        int result;
+        if (!io->wait(request, result)) break;
+        if (result > 0 && request->done + size_t(result) < request->length && ok) {
+            request->done += size_t(result);
+            if (io->submit(request)) continue;
+        }
+        --inFlight;
+    }
+    io.reset();
+    for (ReadBuffer& buffer : buffers) free(buffer.memory);
+    close(fd);
+    return ok;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "MappedFile.h"
+#include "CsvTokenizer.h"
+#include "CsvIndex.h"
+#include "Dataset.h"
+
+// Sidecar Bloom filter of the values of one column of one CSV file, for ruling out the files of a directory
+// dataset that cannot hold a searched value before any of them is read. The filter is sized for the column's
+// distinct values and the requested false-positive rate; the k bit positions of a value come from its index
+// hash by double hashing. Like the index it carries the CSV's size and mtime and is ignored once the CSV
+// changed. A filter needs no byte offsets, so compressed files get one too.
+
+struct BloomHeader {
+    char magic[8];
+    FileStamp stamp;
+    uint64_t column;
+    uint64_t bitCount; // multiple of 64
+    uint64_t hashCount;
+    double falsePositiveRate; // the rate it was sized for
+    char columnName[64];
+};
+
+constexpr char kBloomMagic[8] = {'C', 'S', 'V', 'B', 'L', 'M', '1', '\0'};
+constexpr double defaultBloomFalsePositiveRate = 0.01;
+
+inline std::string bloomPathFor(const std::string& csvPath, const std::string& columnName) {
+    return sidecarPathFor(csvPath, columnName, ".bloom");
+}
+
+// i-th bit position of a value hash: h1 + i * h2, with h2 odd and taken from the high bits
+inline uint64_t bloomBit(uint64_t hash, uint64_t i, uint64_t bitCount) {
+    uint64_t second = ((hash >> 32) | (hash << 32)) * 0x9E3779B97F4A7C15ull | 1;
+    return (hash + i * second) % bitCount;
+}
+
+// Build the filter of `column` over body (the records of the file) and write it next to the CSV; cells are
+// hashed as the index hashes them, trimmed first when the dataset pads them with spaces
+inline bool writeBloomFilter(const std::string& csvPath, const std::string& columnName, size_t column, std::string_view body,
+                             double falsePositiveRate, char delimiter = ',', bool trim = false) {
+    FileStamp stamp;
+    if (!stamp.read(csvPath)) return false;
+    CsvTokenizer tokenizer(delimiter);
+    RecordProbe probe;
+    std::vector<uint64_t> hashes;
+    while (!body.empty()) {
+        tokenizer.probeRecord(body, column, probe);
+        if (!probe.hasField) continue;
+        hashes.push_back(hashFieldValue(trim ? trimSpaces(probe.field) : probe.field));
+    }
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+
+    // m = -n ln p / (ln 2)^2 bits and k = m / n ln 2 hashes for n distinct values
+    falsePositiveRate = std::min(std::max(falsePositiveRate, 1e-9), 0.5);
+    double distinct = double(std::max<size_t>(hashes.size(), 1));
+    uint64_t bitCount = uint64_t(std::ceil(-distinct * std::log(falsePositiveRate) / (std::log(2.0) * std::log(2.0))));
+    bitCount = std::max<uint64_t>((bitCount + 63) & ~uint64_t(63), 64);
+    uint64_t hashCount = std::max<uint64_t>(1, uint64_t(std::lround(double(bitCount) / distinct * std::log(2.0))));
+    std::vector<uint64_t> words(bitCount / 64, 0);
+    for (uint64_t hash : hashes) {
+        for (uint64_t i = 0; i < hashCount; ++i) {
+            uint64_t bit = bloomBit(hash, i, bitCount);
+            words[bit / 64] |= uint64_t(1) << (bit % 64);
+        }
+    }
+
+    BloomHeader header{};
+    std::memcpy(header.magic, kBloomMagic, sizeof(header.magic));
+    header.stamp = stamp;
+    header.column = column;
+    header.bitCount = bitCount;
+    header.hashCount = hashCount;
+    header.falsePositiveRate = falsePositiveRate;
+    std::strncpy(header.columnName, columnName.c_str(), sizeof(header.columnName) - 1);
+
+    return replaceFile(bloomPathFor(csvPath, columnName), [&](FILE* out) {
+        return std::fwrite(&header, sizeof(header), 1, out) == 1 && std::fwrite(words.data(), sizeof(uint64_t), words.size(), out) == words.size();
+    });
+}
+
+// Read side of the Bloom filter sidecar
+class BloomFilter {
+public:
+    // Map the filter for (csvPath, columnName); fails when there is none or the CSV changed since it was built
+    bool open(const std::string& csvPath, const std::string& columnName) {
+        FileStamp stamp;
+        if (!stamp.read(csvPath) || !file_.open(bloomPathFor(csvPath, columnName))) return false;
+        std::string_view data = file_.view();
+        if (data.size() < sizeof(BloomHeader)) return false;
+        std::memcpy(&header_, data.data(), sizeof(header_));
+        if (std::memcmp(header_.magic, kBloomMagic, sizeof(kBloomMagic)) != 0 || !(header_.stamp == stamp) ||
+            columnName.compare(0, sizeof(header_.columnName) - 1, header_.columnName) != 0 || header_.bitCount == 0 ||
+            header_.bitCount % 64 != 0 || data.size() != sizeof(BloomHeader) + header_.bitCount / 8) {
+            file_.close();
+            return false;
+        }
+        words_ = reinterpret_cast<const uint64_t*>(data.data() + sizeof(BloomHeader));
+        return true;
+    }
+
+    size_t column() const { return size_t(header_.column); }
+    double falsePositiveRate() const { return header_.falsePositiveRate; }
+
+    // False only when no cell of the column equals value
+    bool mayContain(std::string_view value) const {
+        uint64_t hash = hashValue(value);
+        for (uint64_t i = 0; i < header_.hashCount; ++i) {
+            uint64_t bit = bloomBit(hash, i, header_.bitCount);
+            if (!(words_[bit / 64] >> (bit % 64) & 1)) return false;
+        }
+        return true;
+    }
+
+private:
+    MappedFile file_;
+    BloomHeader header_;
+    const uint64_t* words_ = nullptr;
+};
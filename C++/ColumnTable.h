@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Column-oriented in-memory table. All cell text is appended to one shared arena and every column keeps its
+// own offset/length arrays into it, so filtering on a column only touches that column's arrays and cells.
+class ColumnTable {
+public:
+    explicit ColumnTable(std::vector<std::string> headers)
+        : headers_(std::move(headers)), starts_(headers_.size()), lengths_(headers_.size()) {}
+
+    const std::vector<std::string>& headers() const { return headers_; }
+    size_t columnCount() const { return headers_.size(); }
+    size_t rowCount() const { return rowWidths_.size(); }
+
+    // Resolve a header to its column once, -1 when the table has no such column
+    int columnIndex(std::string_view header) const {
+        for (size_t i = 0; i < headers_.size(); ++i) {
+            if (headers_[i] == header) return int(i);
+        }
+        return -1;
+    }
+
+    void reserve(size_t rows, size_t arenaBytes) {
+        arena_.reserve(arenaBytes);
+        for (size_t c = 0; c < headers_.size(); ++c) {
+            starts_[c].reserve(rows);
+            lengths_[c].reserve(rows);
+        }
+        rowWidths_.reserve(rows);
+    }
+
+    // Cells are appended left to right; values past the last header are dropped
+    void appendCell(std::string_view value) {
+        if (pendingWidth_ < headers_.size()) {
+            starts_[pendingWidth_].push_back(arena_.size());
+            lengths_[pendingWidth_].push_back(uint32_t(value.size()));
+            arena_.append(value);
+        }
+        ++pendingWidth_;
+    }
+
+    // Close the current row, short rows get empty placeholders so every column stays row-aligned
+    void endRow() {
+        size_t width = pendingWidth_ < headers_.size() ? pendingWidth_ : headers_.size();
+        for (size_t c = width; c < headers_.size(); ++c) {
+            starts_[c].push_back(arena_.size());
+            lengths_[c].push_back(0);
+        }
+        rowWidths_.push_back(uint32_t(width));
+        pendingWidth_ = 0;
+    }
+
+    // Number of cells the row actually had (capped at the header count)
+    size_t rowWidth(size_t row) const { return rowWidths_[row]; }
+    bool hasCell(size_t row, size_t column) const { return column < rowWidths_[row]; }
+
+    std::string_view cell(size_t row, size_t column) const {
+        return std::string_view(arena_.data() + starts_[column][row], lengths_[column][row]);
+    }
+
+private:
+    std::vector<std::string> headers_;
+    std::string arena_;
+    std::vector<std::vector<uint64_t>> starts_;
+    std::vector<std::vector<uint32_t>> lengths_;
+    std::vector<uint32_t> rowWidths_;
+    size_t pendingWidth_ = 0;
+};
@@ -0,0 +1,430 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "MappedFile.h"
+#include "CsvTokenizer.h"
+#include "CsvIndex.h"
+#include "TypedColumns.h"
+#include "PatternMatch.h"
+#include "Dataset.h"
+
+// Columnar sidecar cache of one CSV file, written once by --convert and scanned in place of the CSV afterwards.
+// Every column is stored on its own: numeric columns as one double per row when every cell prints back to its
+// exact text, all others as a sorted dictionary of their distinct cells and one uint32 code per row. Rows are
+// grouped into blocks with a zone map per block and column, so searches and range queries skip the blocks
+// that cannot match without touching their rows. Like the sidecar index the cache carries the CSV's size and
+// mtime and is ignored once the CSV changed.
+
+enum class ColumnEncoding : uint64_t { Int, Float, Dictionary };
+
+struct ColumnarHeader {
+    char magic[8];
+    FileStamp stamp;
+    uint64_t rowCount;
+    uint64_t columnCount;
+    uint64_t blockRows;
+    uint64_t skipRows;
+    uint8_t headerRow;
+    uint8_t trimValues;
+    char delimiter;
+    uint8_t reserved[5];
+    uint64_t offsetsAt; // byte offset of every record in the CSV, uint64 per row
+    uint64_t widthsAt;  // field count of every record, uint32 per row
+};
+
+struct ColumnarColumn {
+    ColumnEncoding encoding;
+    uint64_t valuesAt;       // double or uint32 code per row
+    uint64_t zonesAt;        // ZoneMap per block
+    uint64_t dictionarySize; // distinct cells of a dictionary column
+    uint64_t dictionaryAt;   // end of every entry (uint64) followed by the entries back to back
+};
+
+// min/max over the numeric cells of a block (+inf/-inf when there are none) and over the codes of its rows
+struct ZoneMap {
+    double min;
+    double max;
+    uint32_t minCode;
+    uint32_t maxCode;
+};
+
+constexpr char kColumnarMagic[8] = {'C', 'S', 'V', 'C', 'O', 'L', '1', '\0'};
+constexpr uint64_t columnarBlockRows = 4096;
+
+inline std::string columnarPathFor(const std::string& csvPath) { return csvPath + ".col"; }
+
+// Shortest text of a stored number; empty cells are stored as NaN and print as nothing
+inline std::string_view formatStoredNumber(double value, ColumnEncoding encoding, char (&buffer)[32]) {
+    if (std::isnan(value)) return std::string_view();
+    std::to_chars_result result = encoding == ColumnEncoding::Int ? std::to_chars(buffer, buffer + sizeof(buffer), int64_t(value))
+                                                                   : std::to_chars(buffer, buffer + sizeof(buffer), value);
+    return std::string_view(buffer, size_t(result.ptr - buffer));
+}
+
+// A block may hold a match of p unless its numeric cells all lie on one side of the range
+inline bool zoneMayMatch(const ZoneMap& zone, const RangePredicate& p) {
+    if (zone.min > zone.max) return false;
+    bool belowLow = p.lowInclusive ? zone.max < p.low : zone.max <= p.low;
+    bool aboveHigh = p.highInclusive ? zone.min > p.high : zone.min >= p.high;
+    return !belowLow && !aboveHigh;
+}
+
+// One column while the CSV is read: its distinct cells and whether they can all be stored as numbers
+class ColumnBuilder {
+public:
+    ColumnBuilder(const char* fileBegin, const char* fileEnd) : fileBegin_(fileBegin), fileEnd_(fileEnd) {}
+
+    void add(std::string_view cell) {
+        auto found = codes_.find(cell);
+        if (found == codes_.end()) {
+            // unescaped cells live in the tokenizer's buffer and need a copy, all others point into the file
+            if (cell.data() < fileBegin_ || cell.data() >= fileEnd_) cell = copies_.emplace_back(cell);
+            found = codes_.emplace(cell, uint32_t(distinct_.size())).first;
+            distinct_.push_back(cell);
+            if (!cell.empty()) checkNumber(cell);
+        }
+        rowCodes_.push_back(found->second);
+    }
+
+    ColumnEncoding encoding() const {
+        return isInt_ ? ColumnEncoding::Int : isFloat_ ? ColumnEncoding::Float : ColumnEncoding::Dictionary;
+    }
+
+    // Append the values, zone maps and dictionary of the column to out and describe them in column
+    void write(std::string& out, ColumnarColumn& column) const {
+        column = ColumnarColumn{encoding(), 0, 0, 0, 0};
+        std::vector<double> numbers(distinct_.size());
+        for (size_t i = 0; i < distinct_.size(); ++i) numbers[i] = decodeCell(distinct_[i], ColumnType::Float);
+        // dictionary codes follow the sort order of the cells, so a lookup is a binary search
+        std::vector<uint32_t> order(distinct_.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return distinct_[a] < distinct_[b]; });
+        std::vector<uint32_t> rank(distinct_.size());
+        for (size_t i = 0; i < order.size(); ++i) rank[order[i]] = uint32_t(i);
+
+        const size_t rows = rowCodes_.size();
+        std::vector<ZoneMap> zones;
+        for (size_t begin = 0; begin < rows; begin += columnarBlockRows) {
+            ZoneMap zone{std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(), ~uint32_t(0), 0};
+            for (size_t row = begin; row < std::min<size_t>(rows, begin + columnarBlockRows); ++row) {
+                double number = numbers[rowCodes_[row]];
+                if (!std::isnan(number)) {
+                    zone.min = std::min(zone.min, number);
+                    zone.max = std::max(zone.max, number);
+                }
+                zone.minCode = std::min(zone.minCode, rank[rowCodes_[row]]);
+                zone.maxCode = std::max(zone.maxCode, rank[rowCodes_[row]]);
+            }
+            zones.push_back(zone);
+        }
+
+        column.valuesAt = out.size();
+        if (column.encoding == ColumnEncoding::Dictionary) {
+            std::vector<uint32_t> values(rows);
+            for (size_t row = 0; row < rows; ++row) values[row] = rank[rowCodes_[row]];
+            appendAligned(out, values.data(), rows * sizeof(uint32_t));
+        } else {
+            std::vector<double> values(rows);
+            for (size_t row = 0; row < rows; ++row) values[row] = numbers[rowCodes_[row]];
+            appendAligned(out, values.data(), rows * sizeof(double));
+        }
+        column.zonesAt = out.size();
+        appendAligned(out, zones.data(), zones.size() * sizeof(ZoneMap));
+        if (column.encoding != ColumnEncoding::Dictionary) return;
+
+        column.dictionarySize = distinct_.size();
+        column.dictionaryAt = out.size();
+        std::vector<uint64_t> ends;
+        uint64_t end = 0;
+        for (uint32_t code : order) ends.push_back(end += distinct_[code].size());
+        appendAligned(out, ends.data(), ends.size() * sizeof(uint64_t));
+        for (uint32_t code : order) out.append(distinct_[code]);
+        appendAligned(out, nullptr, 0);
+    }
+
+    static void appendAligned(std::string& out, const void* data, size_t size) {
+        if (size) out.append(static_cast<const char*>(data), size);
+        out.resize((out.size() + 7) & ~size_t(7), '\0');
+    }
+
+private:
+    // a cell only keeps the column numeric when the stored number prints back to exactly the same text
+    void checkNumber(std::string_view cell) {
+        if (!isInt_ && !isFloat_) return;
+        double value;
+        char buffer[32];
+        bool parsed = parseNumber(cell, ColumnType::Float, value) && !std::isnan(value);
+        isInt_ = isInt_ && parsed && std::fabs(value) < 9007199254740992.0 && value == std::trunc(value) &&
+                 formatStoredNumber(value, ColumnEncoding::Int, buffer) == cell;
+        isFloat_ = isFloat_ && parsed && formatStoredNumber(value, ColumnEncoding::Float, buffer) == cell;
+    }
+
+    const char* fileBegin_;
+    const char* fileEnd_;
+    std::unordered_map<std::string_view, uint32_t> codes_; // cell -> code in order of first appearance
+    std::vector<std::string_view> distinct_;
+    std::deque<std::string> copies_;
+    std::vector<uint32_t> rowCodes_;
+    bool isInt_ = true;
+    bool isFloat_ = true;
+};
+
+// Convert body, the records of file (the mapped or decompressed CSV), into the cache next to csvPath. Cells are
+// stored unquoted, and trimmed when the dataset trims them.
+inline bool writeColumnarCache(const std::string& csvPath, std::string_view file, std::string_view body, size_t columnCount,
+                               const DatasetDescriptor& dataset) {
+    FileStamp stamp;
+    if (!stamp.read(csvPath)) return false;
+
+    CsvTokenizer tokenizer(dataset.delimiter);
+    CsvFields fields;
+    std::vector<ColumnBuilder> columns(columnCount, ColumnBuilder(file.data(), file.data() + file.size()));
+    std::vector<uint64_t> offsets;
+    std::vector<uint32_t> widths;
+    while (tokenizer.nextRecord(body, fields)) {
+        size_t width = fields.size();
+        // a delimiter at the end of every line leaves one empty field past the last header
+        if (width == columnCount + 1 && fields[width - 1].empty()) --width;
+        offsets.push_back(uint64_t(fields.record.data() - file.data()));
+        widths.push_back(uint32_t(width));
+        for (size_t c = 0; c < columnCount; ++c) {
+            std::string_view cell = c < width ? fields[c] : std::string_view();
+            columns[c].add(dataset.trimValues ? trimSpaces(cell) : cell);
+        }
+    }
+
+    ColumnarHeader header{};
+    std::memcpy(header.magic, kColumnarMagic, sizeof(header.magic));
+    header.stamp = stamp;
+    header.rowCount = offsets.size();
+    header.columnCount = columnCount;
+    header.blockRows = columnarBlockRows;
+    header.skipRows = dataset.skipRows;
+    header.headerRow = dataset.headerRow;
+    header.trimValues = dataset.trimValues;
+    header.delimiter = dataset.delimiter;
+    std::vector<ColumnarColumn> descriptors(columnCount);
+    std::string out(sizeof(ColumnarHeader) + columnCount * sizeof(ColumnarColumn), '\0');
+    header.offsetsAt = out.size();
+    ColumnBuilder::appendAligned(out, offsets.data(), offsets.size() * sizeof(uint64_t));
+    header.widthsAt = out.size();
+    ColumnBuilder::appendAligned(out, widths.data(), widths.size() * sizeof(uint32_t));
+    for (size_t c = 0; c < columnCount; ++c) columns[c].write(out, descriptors[c]);
+    std::memcpy(&out[0], &header, sizeof(header));
+    if (columnCount) std::memcpy(&out[sizeof(header)], descriptors.data(), columnCount * sizeof(ColumnarColumn));
+
+    return replaceFile(columnarPathFor(csvPath), [&](FILE* stream) { return std::fwrite(out.data(), 1, out.size(), stream) == out.size(); });
+}
+
+// Read side of the columnar cache. Rows are addressed by number; blockCount() blocks of blockRows() rows each
+// are the unit of work and of skipping.
+class ColumnarCache {
+public:
+    // Map the cache of csvPath; fails when there is none, the CSV changed since or it was written for another
+    // layout of the dataset
+    bool open(const std::string& csvPath, const DatasetDescriptor& dataset, size_t columnCount) {
+        FileStamp stamp;
+        if (!stamp.read(csvPath) || !file_.open(columnarPathFor(csvPath))) return false;
+        std::string_view data = file_.view();
+        if (data.size() < sizeof(ColumnarHeader)) return false;
+        std::memcpy(&header_, data.data(), sizeof(header_));
+        if (std::memcmp(header_.magic, kColumnarMagic, sizeof(kColumnarMagic)) != 0 || !(header_.stamp == stamp) ||
+            header_.columnCount != columnCount || header_.blockRows == 0 || header_.skipRows != dataset.skipRows ||
+            bool(header_.headerRow) != dataset.headerRow || bool(header_.trimValues) != dataset.trimValues ||
+            header_.delimiter != dataset.delimiter || data.size() < sizeof(ColumnarHeader) + columnCount * sizeof(ColumnarColumn)) {
+            file_.close();
+            return false;
+        }
+        const char* base = data.data();
+        columns_.assign(reinterpret_cast<const ColumnarColumn*>(base + sizeof(ColumnarHeader)),
+                        reinterpret_cast<const ColumnarColumn*>(base + sizeof(ColumnarHeader)) + columnCount);
+        offsets_ = reinterpret_cast<const uint64_t*>(base + header_.offsetsAt);
+        widths_ = reinterpret_cast<const uint32_t*>(base + header_.widthsAt);
+        numbers_.assign(columnCount, {});
+        return true;
+    }
+
+    size_t rowCount() const { return size_t(header_.rowCount); }
+    size_t blockCount() const { return size_t((header_.rowCount + header_.blockRows - 1) / header_.blockRows); }
+    uint64_t rowOffset(size_t row) const { return offsets_[row]; }
+    size_t rowWidth(size_t row) const { return widths_[row]; }
+
+    // Value of one cell; numbers are printed into buffer, so the view is only good until its next use
+    std::string_view cell(size_t row, size_t column, char (&buffer)[32]) const {
+        const ColumnarColumn& c = columns_[column];
+        if (c.encoding != ColumnEncoding::Dictionary) return formatStoredNumber(doubles(column)[row], c.encoding, buffer);
+        return entry(column, codes(column)[row]);
+    }
+
+    // Range queries on a dictionary column compare the numeric value of each entry; decode them once before
+    // the scan threads start
+    void decodeDictionary(size_t column) {
+        if (columns_[column].encoding != ColumnEncoding::Dictionary || !numbers_[column].empty()) return;
+        numbers_[column].resize(columns_[column].dictionarySize);
+        for (size_t code = 0; code < numbers_[column].size(); ++code) numbers_[column][code] = decodeCell(entry(column, code), ColumnType::Float);
+    }
+
+    // Call onMatch(row) for the rows of blocks [firstBlock, endBlock) whose cell of column equals value, in row
+    // order. onMatch returns false to stop, stop is checked once per block. Returns the number of blocks the
+    // zone maps ruled out.
+    template <class OnMatch>
+    size_t findEqual(size_t column, std::string_view value, size_t firstBlock, size_t endBlock, OnMatch onMatch,
+                     const std::atomic<bool>* stop = nullptr) const {
+        const ColumnarColumn& c = columns_[column];
+        const ZoneMap* zones = reinterpret_cast<const ZoneMap*>(file_.view().data() + c.zonesAt);
+        if (c.encoding == ColumnEncoding::Dictionary) {
+            uint32_t code;
+            if (!findCode(column, value, code)) return endBlock - firstBlock;
+            const uint32_t* rowCodes = codes(column);
+            return scanBlocks(column, firstBlock, endBlock, stop, onMatch,
+                              [&](size_t b) { return zones[b].minCode <= code && code <= zones[b].maxCode; },
+                              [&](size_t row) { return rowCodes[row] == code; });
+        }
+        // every stored number prints as its cell did, so any other spelling of the value matches nothing
+        const double* values = doubles(column);
+        if (value.empty()) {
+            return scanBlocks(column, firstBlock, endBlock, stop, onMatch, [](size_t) { return true; },
+                              [&](size_t row) { return std::isnan(values[row]); });
+        }
+        double number;
+        char buffer[32];
+        if (!parseNumber(value, ColumnType::Float, number) || formatStoredNumber(number, c.encoding, buffer) != value) return endBlock - firstBlock;
+        return scanBlocks(column, firstBlock, endBlock, stop, onMatch,
+                          [&](size_t b) { return zones[b].min <= number && number <= zones[b].max; },
+                          [&](size_t row) { return values[row] == number; });
+    }
+
+    // Prefix, substring and case-insensitive counterpart of findEqual. Every dictionary entry is matched once, and
+    // a block is ruled out when no matching entry lies within its code range.
+    template <class OnMatch>
+    size_t findMatching(size_t column, const PatternMatcher& matcher, size_t firstBlock, size_t endBlock, OnMatch onMatch,
+                        const std::atomic<bool>* stop = nullptr) const {
+        const ColumnarColumn& c = columns_[column];
+        if (c.encoding != ColumnEncoding::Dictionary) {
+            const double* values = doubles(column);
+            char buffer[32];
+            return scanBlocks(column, firstBlock, endBlock, stop, onMatch, [](size_t) { return true; },
+                              [&](size_t row) { return matcher.matches(formatStoredNumber(values[row], c.encoding, buffer)); });
+        }
+        // matchesBelow[code] counts the matching entries with a smaller code
+        std::vector<uint32_t> matchesBelow(size_t(c.dictionarySize) + 1, 0);
+        for (size_t code = 0; code < c.dictionarySize; ++code) matchesBelow[code + 1] = matchesBelow[code] + (matcher.matches(entry(column, code)) ? 1 : 0);
+        if (matchesBelow.back() == 0) return endBlock - firstBlock;
+        const ZoneMap* zones = reinterpret_cast<const ZoneMap*>(file_.view().data() + c.zonesAt);
+        const uint32_t* rowCodes = codes(column);
+        return scanBlocks(column, firstBlock, endBlock, stop, onMatch,
+                          [&](size_t b) { return matchesBelow[zones[b].maxCode + 1] > matchesBelow[zones[b].minCode]; },
+                          [&](size_t row) { return matchesBelow[rowCodes[row] + 1] > matchesBelow[rowCodes[row]]; });
+    }
+
+    // Call onMatch(row) for the rows of blocks [firstBlock, endBlock) that satisfy every predicate, in row order.
+    // Batches of 64 rows go through filter like the CSV scan does; numeric columns are filtered straight from
+    // the mapped cache, dictionary columns through the decoded value of each entry. Returns the number of
+    // blocks the zone maps ruled out.
+    template <class OnMatch>
+    size_t findInRanges(const std::vector<RangePredicate>& predicates, RangeFilterFn filter, size_t firstBlock, size_t endBlock,
+                        OnMatch onMatch, const std::atomic<bool>* stop = nullptr) const {
+        constexpr size_t batchSize = 64;
+        std::vector<double> gathered(predicates.size() * batchSize);
+        size_t skipped = 0;
+        for (size_t b = firstBlock; b < endBlock; ++b) {
+            if (stop && stop->load(std::memory_order_relaxed)) break;
+            bool mayMatch = true;
+            for (const RangePredicate& p : predicates) {
+                const ZoneMap* zones = reinterpret_cast<const ZoneMap*>(file_.view().data() + columns_[p.column].zonesAt);
+                mayMatch = mayMatch && zoneMayMatch(zones[b], p);
+            }
+            if (!mayMatch) {
+                ++skipped;
+                continue;
+            }
+            size_t end = blockEnd(b);
+            for (size_t row = b * header_.blockRows; row < end; row += batchSize) {
+                size_t count = std::min(batchSize, end - row);
+                uint64_t mask = count == 64 ? ~uint64_t(0) : (uint64_t(1) << count) - 1;
+                for (size_t i = 0; i < predicates.size() && mask; ++i) {
+                    const RangePredicate& p = predicates[i];
+                    const double* values;
+                    if (columns_[p.column].encoding != ColumnEncoding::Dictionary) {
+                        values = doubles(p.column) + row;
+                    } else {
+                        const uint32_t* rowCodes = codes(p.column) + row;
+                        for (size_t r = 0; r < count; ++r) gathered[i * batchSize + r] = numbers_[p.column][rowCodes[r]];
+                        values = &gathered[i * batchSize];
+                    }
+                    mask &= filter(values, count, p);
+                }
+                while (mask) {
+                    int bit = __builtin_ctzll(mask);
+                    mask &= mask - 1;
+                    if (!onMatch(row + size_t(bit))) return skipped;
+                }
+            }
+        }
+        return skipped;
+    }
+
+private:
+    size_t blockEnd(size_t block) const { return size_t(std::min(header_.rowCount, (block + 1) * header_.blockRows)); }
+
+    const double* doubles(size_t column) const { return reinterpret_cast<const double*>(file_.view().data() + columns_[column].valuesAt); }
+    const uint32_t* codes(size_t column) const { return reinterpret_cast<const uint32_t*>(file_.view().data() + columns_[column].valuesAt); }
+
+    std::string_view entry(size_t column, size_t code) const {
+        const ColumnarColumn& c = columns_[column];
+        const uint64_t* ends = reinterpret_cast<const uint64_t*>(file_.view().data() + c.dictionaryAt);
+        const char* text = reinterpret_cast<const char*>(ends + c.dictionarySize);
+        uint64_t begin = code == 0 ? 0 : ends[code - 1];
+        return std::string_view(text + begin, size_t(ends[code] - begin));
+    }
+
+    bool findCode(size_t column, std::string_view value, uint32_t& code) const {
+        size_t low = 0;
+        size_t high = size_t(columns_[column].dictionarySize);
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            if (entry(column, middle) < value) low = middle + 1;
+            else high = middle;
+        }
+        code = uint32_t(low);
+        return low < columns_[column].dictionarySize && entry(column, low) == value;
+    }
+
+    // Rows that are too short to have the column never match, as in the CSV scan
+    template <class OnMatch, class BlockTest, class RowTest>
+    size_t scanBlocks(size_t column, size_t firstBlock, size_t endBlock, const std::atomic<bool>* stop, OnMatch& onMatch,
+                      BlockTest mayMatch, RowTest matches) const {
+        size_t skipped = 0;
+        for (size_t b = firstBlock; b < endBlock; ++b) {
+            if (stop && stop->load(std::memory_order_relaxed)) break;
+            if (!mayMatch(b)) {
+                ++skipped;
+                continue;
+            }
+            for (size_t row = b * header_.blockRows, end = blockEnd(b); row < end; ++row) {
+                if (matches(row) && widths_[row] > column && !onMatch(row)) return skipped;
+            }
+        }
+        return skipped;
+    }
+
+    MappedFile file_;
+    ColumnarHeader header_;
+    std::vector<ColumnarColumn> columns_;
+    const uint64_t* offsets_ = nullptr;
+    const uint32_t* widths_ = nullptr;
+    std::vector<std::vector<double>> numbers_; // decoded dictionary entries, per column
+};
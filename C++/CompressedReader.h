@@ -0,0 +1,355 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "BlockReader.h"
+#include "CsvTokenizer.h"
+#include "MappedFile.h"
+#include "StageStats.h"
+#ifdef CSV_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef CSV_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+// Streaming reader for gzip and zstd compressed CSVs. Decompressed blocks are stitched together on record
+// boundaries in file order and handed to parser threads through a bounded queue, like the blocks of
+// BlockReader. A deflate stream can only be inflated front to back, so gzip runs on one thread that feeds the
+// parsers. zstd files in the seekable format (independent frames followed by a seek table) are decompressed
+// frame by frame on several threads; other zstd files go through one streaming decoder.
+// gzip needs -DCSV_WITH_ZLIB -lz and zstd -DCSV_WITH_ZSTD -lzstd at build time.
+
+enum class Compression { None, Gzip, Zstd };
+
+// By magic number, so a file does not need the right extension
+inline Compression detectCompression(const std::string& path) {
+    unsigned char magic[4] = {};
+    FILE* in = std::fopen(path.c_str(), "rb");
+    if (!in) return Compression::None;
+    size_t n = std::fread(magic, 1, sizeof(magic), in);
+    std::fclose(in);
+    if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) return Compression::Gzip;
+    if (n == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) return Compression::Zstd;
+    return Compression::None;
+}
+
+inline const char* compressionName(Compression compression) {
+    return compression == Compression::Gzip ? "gzip" : compression == Compression::Zstd ? "zstd" : "none";
+}
+
+// Sequential source of decompressed bytes
+class Decompressor {
+public:
+    virtual ~Decompressor() = default;
+    // Next block of the decompressed stream; false at the end, or on error with error set
+    virtual bool next(std::string& block, std::string& error) = 0;
+};
+
+#ifdef CSV_WITH_ZLIB
+// Inflates concatenated gzip members from the mapped file on the calling thread
+class GzipDecompressor : public Decompressor {
+public:
+    GzipDecompressor(std::string_view input, size_t blockSize) : input_(input), blockSize_(blockSize) {
+        std::memset(&stream_, 0, sizeof(stream_));
+        ready_ = inflateInit2(&stream_, 16 + MAX_WBITS) == Z_OK;
+        stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input_.data()));
+        stream_.avail_in = uInt(std::min<size_t>(input_.size(), 1u << 30));
+    }
+    ~GzipDecompressor() override {
+        if (ready_) inflateEnd(&stream_);
+    }
+
+    bool next(std::string& block, std::string& error) override {
+        if (!ready_) {
+            error = "inflateInit2 failed";
+            return false;
+        }
+        block.resize(blockSize_);
+        size_t filled = 0;
+        while (filled < block.size() && !finished_) {
+            refill();
+            stream_.next_out = reinterpret_cast<Bytef*>(&block[filled]);
+            stream_.avail_out = uInt(block.size() - filled);
+            int status = inflate(&stream_, Z_NO_FLUSH);
+            filled = block.size() - stream_.avail_out;
+            if (status == Z_STREAM_END) {
+                // another member may follow, as written by pigz or cat a.gz b.gz
+                refill();
+                if (stream_.avail_in == 0) finished_ = true;
+                else inflateReset(&stream_);
+            } else if (status != Z_OK && !(status == Z_BUF_ERROR && stream_.avail_in > 0)) {
+                error = std::string("inflate: ") + (stream_.msg ? stream_.msg : "corrupt or truncated input");
+                return false;
+            }
+        }
+        block.resize(filled);
+        return filled > 0;
+    }
+
+private:
+    // zlib counts input in 32 bits, very large files are fed in pieces
+    void refill() {
+        if (stream_.avail_in > 0) return;
+        size_t consumed = size_t(reinterpret_cast<const char*>(stream_.next_in) - input_.data());
+        stream_.avail_in = uInt(std::min<size_t>(input_.size() - consumed, 1u << 30));
+    }
+
+    std::string_view input_;
+    size_t blockSize_;
+    z_stream stream_;
+    bool ready_ = false;
+    bool finished_ = false;
+};
+#endif
+
+#ifdef CSV_WITH_ZSTD
+// Frames listed in the seek table at the end of a seekable zstd file, empty when there is none
+struct ZstdFrame {
+    uint64_t offset;
+    uint32_t compressedSize;
+    uint32_t decompressedSize;
+};
+
+inline std::vector<ZstdFrame> readZstdSeekTable(std::string_view input) {
+    auto le32 = [](const char* p) {
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        return v;
+    };
+    std::vector<ZstdFrame> frames;
+    if (input.size() < 17 || le32(input.data() + input.size() - 4) != 0x8F92EAB1u) return frames;
+    uint32_t count = le32(input.data() + input.size() - 9);
+    uint8_t descriptor = uint8_t(input[input.size() - 5]);
+    size_t entrySize = (descriptor & 0x80) ? 12 : 8;
+    size_t tableSize = 8 + size_t(count) * entrySize + 9;
+    if (tableSize > input.size()) return frames;
+    const char* table = input.data() + input.size() - tableSize;
+    if (le32(table) != 0x184D2A5Eu) return frames;
+    uint64_t offset = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        const char* entry = table + 8 + i * entrySize;
+        frames.push_back({offset, le32(entry), le32(entry + 4)});
+        offset += frames.back().compressedSize;
+    }
+    if (offset != input.size() - tableSize) frames.clear();
+    return frames;
+}
+
+// Seekable zstd: decoder threads take frames in order and decompress each into its own block; next() hands them
+// out in file order. At most a few frames per thread are decoded ahead of the consumer.
+class ZstdSeekableDecompressor : public Decompressor {
+public:
+    ZstdSeekableDecompressor(std::string_view input, std::vector<ZstdFrame> frames, size_t numThreads)
+        : input_(input), frames_(std::move(frames)), window_(numThreads * 2) {
+        for (size_t i = 0; i < numThreads; ++i) threads_.emplace_back([this] { decode(); });
+    }
+    ~ZstdSeekableDecompressor() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        changed_.notify_all();
+        for (auto& thread : threads_) thread.join();
+    }
+
+    bool next(std::string& block, std::string& error) override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (delivered_ == frames_.size()) return false;
+        changed_.wait(lock, [&] { return done_.count(delivered_) || !error_.empty(); });
+        if (!error_.empty()) {
+            error = error_;
+            return false;
+        }
+        block = std::move(done_[delivered_]);
+        done_.erase(delivered_++);
+        changed_.notify_all();
+        return true;
+    }
+
+private:
+    void decode() {
+        ZSTD_DCtx* context = ZSTD_createDCtx();
+        while (true) {
+            size_t frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                changed_.wait(lock, [&] { return stopping_ || nextFrame_ >= frames_.size() || nextFrame_ < delivered_ + window_; });
+                if (stopping_ || nextFrame_ >= frames_.size()) break;
+                frame = nextFrame_++;
+            }
+            const ZstdFrame& f = frames_[frame];
+            std::string block(f.decompressedSize, '\0');
+            size_t n = ZSTD_decompressDCtx(context, &block[0], block.size(), input_.data() + f.offset, f.compressedSize);
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (ZSTD_isError(n) || n != f.decompressedSize) {
+                error_ = std::string("zstd frame ") + std::to_string(frame) + ": " + (ZSTD_isError(n) ? ZSTD_getErrorName(n) : "size mismatch");
+            } else {
+                done_[frame] = std::move(block);
+            }
+            changed_.notify_all();
+        }
+        ZSTD_freeDCtx(context);
+    }
+
+    std::string_view input_;
+    std::vector<ZstdFrame> frames_;
+    size_t window_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::map<size_t, std::string> done_;
+    size_t nextFrame_ = 0;
+    size_t delivered_ = 0;
+    bool stopping_ = false;
+    std::string error_;
+    std::vector<std::thread> threads_;
+};
+
+// Plain zstd stream, decompressed on the calling thread
+class ZstdStreamDecompressor : public Decompressor {
+public:
+    ZstdStreamDecompressor(std::string_view input, size_t blockSize) : context_(ZSTD_createDCtx()), in_{input.data(), input.size(), 0}, blockSize_(blockSize) {}
+    ~ZstdStreamDecompressor() override { ZSTD_freeDCtx(context_); }
+
+    bool next(std::string& block, std::string& error) override {
+        block.resize(blockSize_);
+        ZSTD_outBuffer out{&block[0], block.size(), 0};
+        while (out.pos < out.size) {
+            size_t produced = out.pos;
+            size_t consumed = in_.pos;
+            size_t status = ZSTD_decompressStream(context_, &out, &in_);
+            if (ZSTD_isError(status)) {
+                error = std::string("zstd: ") + ZSTD_getErrorName(status);
+                return false;
+            }
+            // the input is used up and nothing was left buffered in the decoder
+            if (out.pos == produced && in_.pos == consumed) break;
+        }
+        block.resize(out.pos);
+        return out.pos > 0;
+    }
+
+private:
+    ZSTD_DCtx* context_;
+    ZSTD_inBuffer in_;
+    size_t blockSize_;
+};
+#endif
+
+inline std::unique_ptr<Decompressor> makeDecompressor(Compression compression, std::string_view input, size_t blockSize,
+                                                      size_t numThreads, std::string& error) {
+#ifdef CSV_WITH_ZLIB
+    if (compression == Compression::Gzip) return std::make_unique<GzipDecompressor>(input, blockSize);
+#endif
+#ifdef CSV_WITH_ZSTD
+    if (compression == Compression::Zstd) {
+        std::vector<ZstdFrame> frames = readZstdSeekTable(input);
+        if (!frames.empty() && numThreads > 1) return std::make_unique<ZstdSeekableDecompressor>(input, std::move(frames), numThreads);
+        return std::make_unique<ZstdStreamDecompressor>(input, blockSize);
+    }
+#endif
+    (void)input;
+    (void)blockSize;
+    (void)numThreads;
+    error = std::string("reading ") + compressionName(compression) + " input needs a build with " +
+            (compression == Compression::Gzip ? "-DCSV_WITH_ZLIB -lz" : "-DCSV_WITH_ZSTD -lzstd");
+    return nullptr;
+}
+
+// Decompress the first bytes of path, enough for the header rows and a schema sample (std::string::npos for all)
+inline bool readDecompressedPrefix(const std::string& path, Compression compression, size_t bytes, std::string& prefix, std::string& error) {
+    MappedFile file;
+    if (!file.open(path)) {
+        error = "could not open " + path;
+        return false;
+    }
+    std::unique_ptr<Decompressor> decompressor = makeDecompressor(compression, file.view(), 1 << 20, 1, error);
+    if (!decompressor) return false;
+    prefix.clear();
+    std::string block;
+    while (prefix.size() < bytes && decompressor->next(block, error)) prefix += block;
+    return error.empty();
+}
+
+// Decompress path and call parse(chunk, chunkOffset, parser) on numParsers threads, every chunk holding whole
+// records only. The first skipRecords records (the header rows) are dropped and offsets count decompressed
+// bytes. Seekable zstd is decompressed on numDecoders threads. stop may be set by a parser to end early.
+inline bool streamCompressedRecords(const std::string& path, Compression compression, char delimiter, size_t skipRecords, size_t numParsers,
+                                    size_t numDecoders, size_t blockSize, const std::function<void(std::string_view, uint64_t, size_t)>& parse,
+                                    const std::atomic<bool>* stop, std::string& error) {
+    MappedFile file;
+    StageTimer readTimer;
+    if (!file.open(path)) {
+        error = "could not open " + path;
+        return false;
+    }
+    readTimer.lap(Stage::Read);
+    madvise(const_cast<char*>(file.view().data()), file.size(), MADV_WILLNEED);
+    std::unique_ptr<Decompressor> decompressor = makeDecompressor(compression, file.view(), blockSize, numDecoders, error);
+    if (!decompressor) return false;
+
+    struct Chunk {
+        std::shared_ptr<std::string> text;
+        uint64_t offset = 0;
+    };
+    BoundedQueue<Chunk> chunks(numParsers * 2);
+    std::vector<std::thread> parsers;
+    for (size_t i = 0; i < numParsers; ++i) {
+        parsers.emplace_back([&, i] {
+            Chunk chunk;
+            // waiting for decompressed data is the read stage of a parser thread
+            StageTimer timer;
+            while (chunks.pop(chunk)) {
+                timer.lap(Stage::Read);
+                parse(*chunk.text, chunk.offset, i);
+                timer.skip();
+                chunk = Chunk();
+            }
+        });
+    }
+
+    // the decompressing thread charges its own time to read as well
+    CsvTokenizer tokenizer(delimiter);
+    CsvFields fields;
+    StageTimer timer;
+    std::string block;
+    std::string carry;
+    uint64_t position = 0; // decompressed bytes seen so far
+    while (!(stop && stop->load()) && decompressor->next(block, error)) {
+        position += block.size();
+        auto text = std::make_shared<std::string>(std::move(carry));
+        text->append(block);
+        size_t boundary = tokenizer.lastRecordEnd(*text);
+        size_t begin = 0;
+        for (std::string_view head(text->data(), boundary); skipRecords > 0 && tokenizer.nextRecord(head, fields); --skipRecords) {
+            begin = boundary - head.size();
+        }
+        carry.assign(*text, boundary, std::string::npos);
+        text->resize(boundary);
+        text->erase(0, begin);
+        uint64_t offset = position - carry.size() - text->size();
+        timer.lap(Stage::Read);
+        if (!text->empty()) chunks.push({text, offset});
+        timer.skip();
+    }
+    bool ok = error.empty();
+    // a last record without line end, unless it is a header row of a file without records
+    if (ok && !carry.empty() && skipRecords == 0 && !(stop && stop->load())) {
+        uint64_t offset = position - carry.size();
+        chunks.push({std::make_shared<std::string>(std::move(carry)), offset});
+    }
+    chunks.close();
+    for (auto& parser : parsers) parser.join();
+    return ok;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Where the scan threads run. The CPUs come from the affinity mask of the process (a taskset or cgroup limit
+// shrinks the pool) and are grouped by NUMA node from sysfs. Every search takes its CPUs from a budget shared
+// by all searches on the machine: one lock file per CPU, held with flock() while the search runs, so concurrent
+// searches spread over disjoint CPUs instead of oversubscribing them, and the locks go away with the process
+// however it ends. Workers are pinned to their CPU, so the buffers a worker allocates itself (its arena
+// blocks and result buffers) are first touched, and placed, on its own node.
+
+// "0-3,8,10-11" as in sysfs cpulist files
+inline std::vector<int> parseCpuList(const std::string& text) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t comma = text.find(',', pos);
+        std::string item = text.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        pos = comma == std::string::npos ? text.size() : comma + 1;
+        if (item.find_first_of("0123456789") == std::string::npos) continue;
+        size_t dash = item.find('-');
+        int first = std::atoi(item.c_str());
+        int last = dash == std::string::npos ? first : std::atoi(item.c_str() + dash + 1);
+        for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+// CPUs the process may run on in placement order: one from each NUMA node in turn, so a pool smaller than the
+// machine still spreads over the memory controllers of every node
+inline const std::vector<int>& placementCpus() {
+    static const std::vector<int> order = [] {
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        std::vector<int> allowed;
+        if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &mask)) allowed.push_back(cpu);
+            }
+        }
+        if (allowed.empty()) {
+            for (long cpu = 0; cpu < std::max(1L, sysconf(_SC_NPROCESSORS_ONLN)); ++cpu) allowed.push_back(int(cpu));
+        }
+
+        std::vector<std::vector<int>> nodes;
+        for (int node = 0;; ++node) {
+            std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::string list;
+            if (!in || !std::getline(in, list)) break;
+            std::vector<int> cpus;
+            for (int cpu : parseCpuList(list)) {
+                if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) cpus.push_back(cpu);
+            }
+            if (!cpus.empty()) nodes.push_back(cpus);
+        }
+        // without NUMA information the allowed CPUs count as one node
+        size_t placed = 0;
+        for (const auto& cpus : nodes) placed += cpus.size();
+        if (placed != allowed.size()) nodes.assign(1, allowed);
+
+        std::vector<int> interleaved;
+        for (size_t i = 0; interleaved.size() < allowed.size(); ++i) {
+            for (const auto& cpus : nodes) {
+                if (i < cpus.size()) interleaved.push_back(cpus[i]);
+            }
+        }
+        return interleaved;
+    }();
+    return order;
+}
+
+inline bool pinThisThread(int cpu) {
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    return sched_setaffinity(0, sizeof(mask), &mask) == 0;
+}
+
+// CPUs held from the machine-wide budget, released on destruction. The lock files live in
+// $CSV_CPU_BUDGET_DIR, /tmp/csvsearch-cpus by default; when they cannot be created the CPUs are handed out
+// without locking.
+class CpuBudget {
+public:
+    CpuBudget() = default;
+    CpuBudget(const CpuBudget&) = delete;
+    CpuBudget& operator=(const CpuBudget&) = delete;
+    ~CpuBudget() { release(); }
+
+    // Take up to wanted free CPUs, waiting for one when all of them are held by other searches
+    void acquire(size_t wanted) {
+        release();
+        const std::vector<int>& order = placementCpus();
+        wanted = std::max<size_t>(1, std::min(wanted, order.size()));
+        const char* dir = std::getenv("CSV_CPU_BUDGET_DIR");
+        std::string directory = dir && *dir ? dir : "/tmp/csvsearch-cpus";
+        mkdir(directory.c_str(), 0777);
+        for (size_t i = 0; i < order.size() && cpus_.size() < wanted; ++i) {
+            int fd = openSlot(directory, order[i]);
+            if (fd < 0) {
+                // no budget to share, run unlocked on the first CPUs
+                release();
+                cpus_.assign(order.begin(), order.begin() + long(wanted));
+                return;
+            }
+            if (flock(fd, LOCK_EX | LOCK_NB) == 0) {
+                cpus_.push_back(order[i]);
+                locks_.push_back(fd);
+            } else {
+                close(fd);
+            }
+        }
+        if (!cpus_.empty()) return;
+        // every CPU is busy: queue behind the holder of the first one
+        int fd = openSlot(directory, order[0]);
+        if (fd >= 0 && flock(fd, LOCK_EX) == 0) locks_.push_back(fd);
+        else if (fd >= 0) close(fd);
+        cpus_.push_back(order[0]);
+    }
+
+    void release() {
+        for (int fd : locks_) close(fd);
+        locks_.clear();
+        cpus_.clear();
+    }
+
+    const std::vector<int>& cpus() const { return cpus_; }
+    size_t size() const { return cpus_.size(); }
+
+private:
+    static int openSlot(const std::string& directory, int cpu) {
+        return open((directory + "/cpu" + std::to_string(cpu)).c_str(), O_RDONLY | O_CREAT | O_CLOEXEC, 0666);
+    }
+
+    std::vector<int> cpus_;
+    std::vector<int> locks_;
+};
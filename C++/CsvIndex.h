@@ -0,0 +1,255 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/stat.h>
+#include "MappedFile.h"
+#include "CsvTokenizer.h"
+#include "Dataset.h"
+
+// Sidecar hash index for point lookups on one column of one CSV file. The file holds an IndexHeader followed
+// by an open-addressing table of (value hash, record byte offset) slots. The CSV's size and mtime are stored
+// in the header and an index whose CSV has changed since is ignored.
+
+// Size and modification time of a file, an index is only used while these still match
+struct FileStamp {
+    uint64_t size = 0;
+    int64_t mtimeSec = 0;
+    int64_t mtimeNsec = 0;
+
+    bool read(const std::string& path) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) return false;
+        size = uint64_t(st.st_size);
+        mtimeSec = int64_t(st.st_mtim.tv_sec);
+        mtimeNsec = int64_t(st.st_mtim.tv_nsec);
+        return true;
+    }
+
+    bool operator==(const FileStamp& other) const {
+        return size == other.size && mtimeSec == other.mtimeSec && mtimeNsec == other.mtimeNsec;
+    }
+};
+
+struct IndexHeader {
+    char magic[8];
+    FileStamp stamp;
+    uint64_t column;
+    uint64_t slotCount; // power of two
+    uint64_t entryCount;
+    char columnName[64];
+};
+
+struct IndexSlot {
+    uint64_t hash;
+    uint64_t offset; // emptySlot when unused
+};
+
+// version 2 hashes the trimmed cells of datasets that trim them, older indexes are rebuilt
+constexpr char kIndexMagic[8] = {'C', 'S', 'V', 'I', 'D', 'X', '2', '\0'};
+constexpr uint64_t emptySlot = ~uint64_t(0);
+
+// FNV-1a hash of a plain value
+inline uint64_t hashValue(std::string_view value) {
+    uint64_t h = 1469598103934665603ull;
+    for (char c : value) h = (h ^ uint8_t(c)) * 1099511628211ull;
+    return h;
+}
+
+// Same hash over the logical value of a raw field: surrounding quotes are skipped and "" counts as one quote,
+// so hashFieldValue("\"Cuba\"") == hashValue("Cuba")
+inline uint64_t hashFieldValue(std::string_view raw) {
+    if (raw.size() < 2 || raw.front() != '"' || raw.back() != '"') return hashValue(raw);
+    raw = raw.substr(1, raw.size() - 2);
+    uint64_t h = 1469598103934665603ull;
+    for (size_t i = 0; i < raw.size(); ++i) {
+        h = (h ^ uint8_t(raw[i])) * 1099511628211ull;
+        if (raw[i] == '"' && i + 1 < raw.size() && raw[i + 1] == '"') ++i;
+    }
+    return h;
+}
+
+// Sidecar file name for a (csv, column) pair such as <csv>.<column>.idx, characters that are awkward in file
+// names become '_'
+inline std::string sidecarPathFor(const std::string& csvPath, const std::string& columnName, const char* extension) {
+    std::string path = csvPath + ".";
+    for (char c : columnName) path += (isalnum(uint8_t(c)) || c == '.' || c == '-') ? c : '_';
+    return path + extension;
+}
+
+inline std::string indexPathFor(const std::string& csvPath, const std::string& columnName) {
+    return sidecarPathFor(csvPath, columnName, ".idx");
+}
+
+// Write header and slots to the index path of (csvPath, columnName); replaceFile keeps readers from seeing a
+// half written index
+inline bool saveCsvIndex(const std::string& csvPath, const std::string& columnName, const IndexHeader& header, const std::vector<IndexSlot>& slots) {
+    return replaceFile(indexPathFor(csvPath, columnName), [&](FILE* out) {
+        return std::fwrite(&header, sizeof(header), 1, out) == 1 &&
+               std::fwrite(slots.data(), sizeof(IndexSlot), slots.size(), out) == slots.size();
+    });
+}
+
+// Build the index of `column` over body, a byte range of the mapped file (the records after the header row).
+// Offsets are stored relative to the start of the file. Cells are hashed as lookups compare them, trimmed first
+// when the dataset pads them with spaces.
+inline bool writeCsvIndex(const std::string& csvPath, const std::string& columnName, size_t column,
+                          std::string_view file, std::string_view body, size_t numThreads, char delimiter = ',', bool trim = false) {
+    FileStamp stamp;
+    if (!stamp.read(csvPath)) return false;
+
+    CsvTokenizer tokenizer(delimiter);
+    std::vector<std::string_view> ranges = tokenizer.splitIntoRecordRanges(body, numThreads);
+    std::vector<std::vector<IndexSlot>> partials(ranges.size());
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(numThreads)
+#endif
+    for (size_t r = 0; r < ranges.size(); ++r) {
+        std::string_view range = ranges[r];
+        RecordProbe probe;
+        while (!range.empty()) {
+            uint64_t offset = uint64_t(range.data() - file.data());
+            tokenizer.probeRecord(range, column, probe);
+            if (probe.hasField) partials[r].push_back({hashFieldValue(trim ? trimSpaces(probe.field) : probe.field), offset});
+        }
+    }
+
+    uint64_t entryCount = 0;
+    for (const auto& partial : partials) entryCount += partial.size();
+    uint64_t slotCount = 16;
+    while (slotCount < entryCount * 2) slotCount <<= 1;
+    std::vector<IndexSlot> slots(slotCount, IndexSlot{0, emptySlot});
+    // ranges are inserted in file order so rows with the same value come back in file order
+    for (const auto& partial : partials) {
+        for (const IndexSlot& entry : partial) {
+            uint64_t i = entry.hash & (slotCount - 1);
+            while (slots[i].offset != emptySlot) i = (i + 1) & (slotCount - 1);
+            slots[i] = entry;
+        }
+    }
+
+    IndexHeader header{};
+    std::memcpy(header.magic, kIndexMagic, sizeof(header.magic));
+    header.stamp = stamp;
+    header.column = column;
+    header.slotCount = slotCount;
+    header.entryCount = entryCount;
+    std::strncpy(header.columnName, columnName.c_str(), sizeof(header.columnName) - 1);
+    return saveCsvIndex(csvPath, columnName, header, slots);
+}
+
+// Bring the index of a CSV that only grew by appends up to date: the records past the size the index was
+// built at are added to its table, which doubles (and is refilled in file order) once it is half full. file is
+// the mapped CSV. Fails when there is no index of the column, or when the CSV shrank or does not end on a line
+// break at both sizes; the index then has to be rebuilt.
+inline bool extendCsvIndex(const std::string& csvPath, const std::string& columnName, size_t column, std::string_view file,
+                           char delimiter = ',', bool trim = false) {
+    FileStamp stamp;
+    MappedFile existing;
+    if (!stamp.read(csvPath) || stamp.size != file.size() || !existing.open(indexPathFor(csvPath, columnName))) return false;
+    std::string_view data = existing.view();
+    IndexHeader header;
+    if (data.size() < sizeof(IndexHeader)) return false;
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, kIndexMagic, sizeof(kIndexMagic)) != 0 || header.column != column ||
+        columnName.compare(0, sizeof(header.columnName) - 1, header.columnName) != 0 ||
+        data.size() != sizeof(IndexHeader) + header.slotCount * sizeof(IndexSlot)) {
+        return false;
+    }
+    if (header.stamp == stamp) return true;
+    uint64_t from = header.stamp.size;
+    if (from == 0 || from > file.size() || file[from - 1] != '\n' || file.back() != '\n') return false;
+
+    const IndexSlot* stored = reinterpret_cast<const IndexSlot*>(data.data() + sizeof(IndexHeader));
+    std::vector<IndexSlot> slots(stored, stored + header.slotCount);
+    std::vector<IndexSlot> added;
+    CsvTokenizer tokenizer(delimiter);
+    RecordProbe probe;
+    std::string_view rest = file.substr(from);
+    while (!rest.empty()) {
+        uint64_t offset = uint64_t(rest.data() - file.data());
+        tokenizer.probeRecord(rest, column, probe);
+        if (probe.hasField) added.push_back({hashFieldValue(trim ? trimSpaces(probe.field) : probe.field), offset});
+    }
+
+    header.stamp = stamp;
+    header.entryCount += added.size();
+    if (header.entryCount * 2 > header.slotCount) {
+        for (const IndexSlot& slot : slots) {
+            if (slot.offset != emptySlot) added.push_back(slot);
+        }
+        std::sort(added.begin(), added.end(), [](const IndexSlot& a, const IndexSlot& b) { return a.offset < b.offset; });
+        while (header.entryCount * 2 > header.slotCount) header.slotCount <<= 1;
+        slots.assign(header.slotCount, IndexSlot{0, emptySlot});
+    }
+    // the new records lie past every stored one, so probe chains stay in file order
+    for (const IndexSlot& entry : added) {
+        uint64_t i = entry.hash & (header.slotCount - 1);
+        while (slots[i].offset != emptySlot) i = (i + 1) & (header.slotCount - 1);
+        slots[i] = entry;
+    }
+    existing.close();
+    return saveCsvIndex(csvPath, columnName, header, slots);
+}
+
+// Read side of the sidecar index
+class CsvIndex {
+public:
+    // Map the index for (csvPath, columnName); fails when there is none or the CSV changed since it was built
+    bool open(const std::string& csvPath, const std::string& columnName) {
+        FileStamp stamp;
+        if (!stamp.read(csvPath) || !file_.open(indexPathFor(csvPath, columnName))) return false;
+        std::string_view data = file_.view();
+        if (data.size() < sizeof(IndexHeader)) return false;
+        std::memcpy(&header_, data.data(), sizeof(header_));
+        if (std::memcmp(header_.magic, kIndexMagic, sizeof(kIndexMagic)) != 0 || !(header_.stamp == stamp) ||
+            columnName.compare(0, sizeof(header_.columnName) - 1, header_.columnName) != 0 ||
+            data.size() != sizeof(IndexHeader) + header_.slotCount * sizeof(IndexSlot)) {
+            file_.close();
+            return false;
+        }
+        slots_ = reinterpret_cast<const IndexSlot*>(data.data() + sizeof(IndexHeader));
+        return true;
+    }
+
+    size_t column() const { return size_t(header_.column); }
+
+    // Byte offsets of the records whose value hashes like `value`. Hash collisions are possible, so callers
+    // still compare the field of every record they get back.
+    void lookup(std::string_view value, std::vector<uint64_t>& offsets) const {
+        offsets.clear();
+        uint64_t hash = hashValue(value);
+        uint64_t mask = header_.slotCount - 1;
+        for (uint64_t i = hash & mask; slots_[i].offset != emptySlot; i = (i + 1) & mask) {
+            if (slots_[i].hash == hash) offsets.push_back(slots_[i].offset);
+        }
+    }
+
+    // Candidate records for `value` cut out of the mapped CSV as byte ranges, in file order
+    std::vector<std::string_view> candidateRecords(std::string_view csv, std::string_view value, char delimiter = ',') const {
+        std::vector<uint64_t> offsets;
+        lookup(value, offsets);
+        std::vector<std::string_view> records;
+        CsvTokenizer tokenizer(delimiter);
+        RecordProbe probe;
+        for (uint64_t offset : offsets) {
+            if (offset >= csv.size()) continue;
+            std::string_view rest = csv.substr(offset);
+            std::string_view record = rest;
+            tokenizer.probeRecord(rest, column(), probe);
+            records.push_back(record.substr(0, record.size() - rest.size()));
+        }
+        return records;
+    }
+
+private:
+    MappedFile file_;
+    IndexHeader header_;
+    const IndexSlot* slots_ = nullptr;
+};
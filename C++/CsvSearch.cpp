@@ -0,0 +1,26 @@
+//count every heap allocation per thread, reported by --stats
+#define ARENA_COUNT_HEAP
+#include <iostream>
+#include <string>
+#include "SearchEngine.h"
+
+using namespace std;
+
+//search any dataset with the engine of the Data* binaries:
+//    ./CsvSearch <dataset> <header> <value> [first|first-per-file|all] [options]
+//<dataset> is data1, data2 or data3, a descriptor file ending in .dataset (see Dataset.h), or a csv file,
+//directory or glob whose first line is the header row. The strategy is parallel unless --strategy= says otherwise.
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        cout << "Usage: CsvSearch <dataset> <header> <value> [options]" << endl;
+        return 1;
+    }
+    DatasetDescriptor dataset;
+    string error;
+    if (!resolveDataset(argv[1], dataset, error)) {
+        cerr << "Error: " << error << endl;
+        return 1;
+    }
+    //the dataset takes the place of the program name
+    return searchMain(argc - 1, argv + 1, dataset, Strategy::Parallel);
+}
@@ -0,0 +1,345 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Arena.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Bit i of each mask is set when byte i of a 64-byte block is that character
+struct BlockMasks {
+    uint64_t delimiter = 0;
+    uint64_t quote = 0;
+    uint64_t newline = 0;
+};
+
+enum class ScanKernel { Scalar, Sse2, Avx2 };
+
+using ScanBlockFn = BlockMasks (*)(const char* block, char delimiter);
+
+inline BlockMasks scanBlockScalar(const char* block, char delimiter) {
+    BlockMasks m;
+    for (int i = 0; i < 64; ++i) {
+        uint64_t bit = uint64_t(1) << i;
+        char c = block[i];
+        if (c == delimiter) m.delimiter |= bit;
+        else if (c == '"') m.quote |= bit;
+        else if (c == '\n') m.newline |= bit;
+    }
+    return m;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2"))) inline BlockMasks scanBlockSse2(const char* block, char delimiter) {
+    const __m128i d = _mm_set1_epi8(delimiter);
+    const __m128i q = _mm_set1_epi8('"');
+    const __m128i n = _mm_set1_epi8('\n');
+    BlockMasks m;
+    for (int k = 0; k < 4; ++k) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * k));
+        m.delimiter |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, d)))) << (16 * k);
+        m.quote |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, q)))) << (16 * k);
+        m.newline |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, n)))) << (16 * k);
+    }
+    return m;
+}
+
+__attribute__((target("avx2"))) inline BlockMasks scanBlockAvx2(const char* block, char delimiter) {
+    const __m256i d = _mm256_set1_epi8(delimiter);
+    const __m256i q = _mm256_set1_epi8('"');
+    const __m256i n = _mm256_set1_epi8('\n');
+    BlockMasks m;
+    for (int k = 0; k < 2; ++k) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32 * k));
+        m.delimiter |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, d)))) << (32 * k);
+        m.quote |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, q)))) << (32 * k);
+        m.newline |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, n)))) << (32 * k);
+    }
+    return m;
+}
+#endif
+
+inline bool scanKernelSupported(ScanKernel kernel) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (kernel == ScanKernel::Avx2) return __builtin_cpu_supports("avx2");
+    if (kernel == ScanKernel::Sse2) return __builtin_cpu_supports("sse2");
+#else
+    if (kernel != ScanKernel::Scalar) return false;
+#endif
+    return true;
+}
+
+inline ScanBlockFn scanBlockFor(ScanKernel kernel) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (kernel == ScanKernel::Avx2) return scanBlockAvx2;
+    if (kernel == ScanKernel::Sse2) return scanBlockSse2;
+#endif
+    return scanBlockScalar;
+}
+
+// Widest kernel the running CPU supports, picked once per process
+inline ScanKernel detectScanKernel() {
+    if (scanKernelSupported(ScanKernel::Avx2)) return ScanKernel::Avx2;
+    if (scanKernelSupported(ScanKernel::Sse2)) return ScanKernel::Sse2;
+    return ScanKernel::Scalar;
+}
+
+inline const char* scanKernelName(ScanKernel kernel) {
+    switch (kernel) {
+        case ScanKernel::Avx2: return "avx2";
+        case ScanKernel::Sse2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+// Field boundaries of one record, kept as offsets so the buffers can be reused for every row. Quoted fields
+// point inside their quotes; the few that contain "" escapes are copied once into unescaped. Given an arena, both
+// buffers live in its scratch memory.
+struct CsvFields {
+    struct Span {
+        uint32_t begin;
+        uint32_t end;
+        bool unescaped;
+    };
+
+    explicit CsvFields(Arena* arena = nullptr) : spans(ArenaAllocator<Span>(arena)), unescaped(ArenaAllocator<char>(arena)) {}
+
+    std::string_view record;
+    std::vector<Span, ArenaAllocator<Span>> spans;
+    std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>> unescaped;
+
+    size_t size() const { return spans.size(); }
+    std::string_view operator[](size_t i) const {
+        const Span& span = spans[i];
+        std::string_view source = span.unescaped ? std::string_view(unescaped) : record;
+        return source.substr(span.begin, span.end - span.begin);
+    }
+};
+
+// One record located by CsvTokenizer::probeRecord(), field is still raw (quotes and "" escapes included)
+struct RecordProbe {
+    std::string_view record;
+    std::string_view field;
+    bool hasField = false;
+};
+
+// Compare a raw field against a plain value without copying it: surrounding quotes are skipped and
+// "" escapes are compared as a single quote
+inline bool fieldEquals(std::string_view raw, std::string_view value) {
+    if (raw.size() < 2 || raw.front() != '"' || raw.back() != '"') return raw == value;
+    std::string_view inner = raw.substr(1, raw.size() - 2);
+    if (inner.find('"') == std::string_view::npos) return inner == value;
+    size_t j = 0;
+    for (size_t i = 0; i < inner.size(); ++i, ++j) {
+        if (j >= value.size() || inner[i] != value[j]) return false;
+        if (inner[i] == '"' && i + 1 < inner.size() && inner[i + 1] == '"') ++i;
+    }
+    return j == value.size();
+}
+
+// RFC 4180 record splitter. Every 64-byte block is reduced to bitmasks of delimiters, quotes and newlines and
+// a small state machine walks the set bits, so quoted delimiters, "" escapes and embedded newlines are all
+// handled in the same single pass.
+class CsvTokenizer {
+public:
+    explicit CsvTokenizer(char delimiter = ',', ScanKernel kernel = detectScanKernel())
+        : delimiter_(delimiter), scanBlock_(scanBlockFor(kernel)) {}
+
+    // Pop the next record off the front of text. Returns false once text is empty.
+    bool nextRecord(std::string_view& text, CsvFields& fields) const {
+        if (text.empty()) return false;
+        size_t length = text.size();
+        size_t consumed = text.size();
+        fields.spans.clear();
+        fields.unescaped.clear();
+        size_t fieldBegin = 0;
+        unsigned quotes = 0;
+        bool inQuotes = false;
+        bool done = false;
+        for (size_t blockStart = 0; blockStart < text.size() && !done; blockStart += 64) {
+            BlockMasks m = scan(text.data() + blockStart, text.size() - blockStart);
+            uint64_t bits = m.delimiter | m.newline | m.quote;
+            while (bits) {
+                int bit = __builtin_ctzll(bits);
+                bits &= bits - 1;
+                size_t pos = blockStart + bit;
+                if ((m.quote >> bit) & 1) {
+                    inQuotes = !inQuotes;
+                    ++quotes;
+                    continue;
+                }
+                if (inQuotes) continue;
+                if ((m.newline >> bit) & 1) {
+                    length = pos;
+                    consumed = pos + 1;
+                    done = true;
+                    break;
+                }
+                endField(text, fieldBegin, pos, quotes, fields);
+                fieldBegin = pos + 1;
+                quotes = 0;
+            }
+        }
+        if (length > fieldBegin && text[length - 1] == '\r') --length;
+        endField(text, fieldBegin, std::max(length, fieldBegin), quotes, fields);
+        fields.record = text.substr(0, length);
+        text.remove_prefix(consumed);
+        return true;
+    }
+
+    // Pop the next record off text but only cut out field `column`. Once that field is found the rest of the
+    // record is skipped by looking at newline and quote bits only, nothing is materialised.
+    void probeRecord(std::string_view& text, size_t column, RecordProbe& probe) const {
+        size_t length = text.size();
+        size_t consumed = text.size();
+        size_t fieldIndex = 0;
+        size_t fieldBegin = 0;
+        bool inQuotes = false;
+        bool done = false;
+        probe.hasField = false;
+        for (size_t blockStart = 0; blockStart < text.size() && !done; blockStart += 64) {
+            BlockMasks m = scan(text.data() + blockStart, text.size() - blockStart);
+            uint64_t bits = m.newline | m.quote | (probe.hasField ? 0 : m.delimiter);
+            while (bits) {
+                int bit = __builtin_ctzll(bits);
+                bits &= bits - 1;
+                size_t pos = blockStart + bit;
+                if ((m.quote >> bit) & 1) {
+                    inQuotes = !inQuotes;
+                    continue;
+                }
+                if (inQuotes) continue;
+                if ((m.newline >> bit) & 1) {
+                    length = pos;
+                    consumed = pos + 1;
+                    done = true;
+                    break;
+                }
+                if (probe.hasField) continue;
+                if (fieldIndex == column) {
+                    probe.field = text.substr(fieldBegin, pos - fieldBegin);
+                    probe.hasField = true;
+                }
+                ++fieldIndex;
+                fieldBegin = pos + 1;
+            }
+        }
+        if (length > 0 && text[length - 1] == '\r' && !inQuotes) --length;
+        if (!probe.hasField && fieldIndex == column) {
+            probe.field = text.substr(fieldBegin, std::max(length, fieldBegin) - fieldBegin);
+            probe.hasField = true;
+        }
+        probe.record = text.substr(0, length);
+        text.remove_prefix(consumed);
+    }
+
+    // Tokenize a single record that has already been cut out of the input
+    void splitLine(std::string_view line, CsvFields& fields) const {
+        if (line.empty()) {
+            fields.record = line;
+            fields.unescaped.clear();
+            fields.spans.assign(1, {0, 0, false});
+            return;
+        }
+        nextRecord(line, fields);
+    }
+
+    size_t countQuotes(std::string_view text) const {
+        size_t count = 0;
+        for (size_t blockStart = 0; blockStart < text.size(); blockStart += 64) {
+            count += __builtin_popcountll(scan(text.data() + blockStart, text.size() - blockStart).quote);
+        }
+        return count;
+    }
+
+    // Offset just past the last record-ending newline of text, which must start on a record boundary; 0 when
+    // text holds no complete record yet
+    size_t lastRecordEnd(std::string_view text) const {
+        size_t end = 0;
+        uint64_t inQuotes = 0;
+        for (size_t blockStart = 0; blockStart < text.size(); blockStart += 64) {
+            BlockMasks m = scan(text.data() + blockStart, text.size() - blockStart);
+            // prefix xor of the quote bits marks every byte inside a quoted field
+            uint64_t quoted = m.quote;
+            for (int shift = 1; shift < 64; shift <<= 1) quoted ^= quoted << shift;
+            quoted ^= inQuotes;
+            uint64_t newlines = m.newline & ~quoted;
+            if (newlines) end = blockStart + 64 - __builtin_clzll(newlines);
+            inQuotes = uint64_t(0) - (quoted >> 63);
+        }
+        return end;
+    }
+
+    // Split text into at most numRanges byte ranges that each start on a record boundary. The parity of the
+    // quotes in front of a cut tells whether it landed inside a quoted field; if so the cut moves past the
+    // closing quote before looking for the newline.
+    std::vector<std::string_view> splitIntoRecordRanges(std::string_view text, size_t numRanges) const {
+        if (numRanges == 0) numRanges = 1;
+        size_t target = text.size() / numRanges;
+        std::vector<size_t> quoteCounts(numRanges);
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+        for (size_t i = 0; i < numRanges; ++i) {
+            size_t begin = i * target;
+            size_t end = (i == numRanges - 1) ? text.size() : begin + target;
+            quoteCounts[i] = countQuotes(text.substr(begin, end - begin));
+        }
+
+        std::vector<std::string_view> ranges;
+        size_t begin = 0;
+        size_t quotesBefore = 0;
+        for (size_t i = 1; i <= numRanges && begin < text.size(); ++i) {
+            quotesBefore += quoteCounts[i - 1];
+            size_t end = (i == numRanges) ? text.size() : recordStartAfter(text, i * target, quotesBefore % 2 == 1);
+            if (end > begin) {
+                ranges.push_back(text.substr(begin, end - begin));
+                begin = end;
+            }
+        }
+        return ranges;
+    }
+
+private:
+    BlockMasks scan(const char* p, size_t remaining) const {
+        if (remaining >= 64) return scanBlock_(p, delimiter_);
+        // the last partial block is padded so the kernels never read past the buffer
+        char tail[64];
+        std::memset(tail, 0, sizeof(tail));
+        std::memcpy(tail, p, remaining);
+        if (delimiter_ == '\0') std::memset(tail + remaining, 1, sizeof(tail) - remaining);
+        return scanBlock_(tail, delimiter_);
+    }
+
+    static void endField(std::string_view text, size_t begin, size_t end, unsigned quotes, CsvFields& fields) {
+        if (quotes < 2 || end - begin < 2 || text[begin] != '"' || text[end - 1] != '"') {
+            fields.spans.push_back({uint32_t(begin), uint32_t(end), false});
+        } else if (quotes == 2) {
+            fields.spans.push_back({uint32_t(begin + 1), uint32_t(end - 1), false});
+        } else {
+            size_t out = fields.unescaped.size();
+            for (size_t i = begin + 1; i < end - 1; ++i) {
+                fields.unescaped.push_back(text[i]);
+                if (text[i] == '"' && text[i + 1] == '"') ++i;
+            }
+            fields.spans.push_back({uint32_t(out), uint32_t(fields.unescaped.size()), true});
+        }
+    }
+
+    // First record boundary at or after pos, given whether pos lies inside a quoted field
+    static size_t recordStartAfter(std::string_view text, size_t pos, bool inQuotes) {
+        for (; pos < text.size(); ++pos) {
+            if (text[pos] == '"') inQuotes = !inQuotes;
+            else if (text[pos] == '\n' && !inQuotes) return pos + 1;
+        }
+        return text.size();
+    }
+
+    char delimiter_;
+    ScanBlockFn scanBlock_;
+};
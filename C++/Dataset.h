@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <glob.h>
+#include "CsvTokenizer.h"
+#include "SearchMode.h"
+
+// What the search engine needs to know about a dataset: where its files are and how each file is laid out.
+// The three datasets of the repo are built in, any other one is described in a small text file of
+// "key = value" lines:
+//     name = sensors
+//     path = ../Data Sets/Sensors/*.csv
+//     skip_rows = 0
+//     header_row = false
+//     headers = id,time,value
+//     delimiter = ;
+//     trim = false
+//     schema = value:float
+//     mode = all
+//     threads = 8
+struct DatasetDescriptor {
+    std::string name;
+    std::string path;                 // one file, a directory searched recursively for .csv files, or a glob
+    size_t skipRows = 0;              // rows in front of the header row (or of the first record)
+    bool headerRow = true;            // false when the files carry no header row
+    std::vector<std::string> headers; // custom headers, replace the header row when there is one
+    char delimiter = ',';
+    bool trimValues = false;          // cells padded with spaces are compared and printed trimmed
+    std::string schema;               // "col:type,..." applied on top of the inferred column types
+    MatchMode defaultMode = MatchMode::First;
+    size_t threads = 0;               // fixed thread count of parallel scans, 0 to size it from the input and the free CPUs
+};
+
+inline std::string_view trimSpaces(std::string_view str) {
+    size_t first = str.find_first_not_of(' ');
+    if (first == std::string_view::npos) return "";
+    size_t last = str.find_last_not_of(' ');
+    return str.substr(first, last - first + 1);
+}
+
+// The datasets the Data* binaries search, with paths relative to C++/
+inline bool builtinDataset(std::string_view name, DatasetDescriptor& dataset) {
+    dataset = DatasetDescriptor();
+    dataset.name = std::string(name);
+    if (name == "data1") {
+        dataset.path = "../Data Sets/Data1 - World Bank Population Data/API_SP.POP.TOTL_DS2_en_csv_v2_3401680.csv";
+        dataset.skipRows = 4;
+        dataset.trimValues = true;
+        dataset.defaultMode = MatchMode::All;
+    } else if (name == "data2") {
+        dataset.path = "../Data Sets/Data2 - AirNow 2020 California Complex Fire";
+        dataset.headerRow = false;
+        dataset.headers = {"lat", "lon", "time", "measurement_ozone", "measurement_PM2.5", "measurement_PM10", "measurement_CO",
+                           "measurement_NO2", "measurement_SO2", "location1", "location2", "data1", "data2"};
+        dataset.defaultMode = MatchMode::FirstPerFile;
+    } else if (name == "data3") {
+        dataset.path = "../Data Sets/Data3 - NYC Data Organization/Parking_Violations_Issued_-_Fiscal_Year_2022.csv";
+    } else {
+        return false;
+    }
+    return true;
+}
+
+inline std::vector<std::string> splitList(std::string_view text, char separator = ',') {
+    std::vector<std::string> items;
+    while (!text.empty()) {
+        size_t pos = text.find(separator);
+        items.push_back(std::string(trimSpaces(text.substr(0, pos))));
+        text = pos == std::string_view::npos ? std::string_view() : text.substr(pos + 1);
+    }
+    return items;
+}
+
+// Set one descriptor key, false with error set for unknown keys or bad values
+inline bool setDatasetField(DatasetDescriptor& dataset, std::string_view key, std::string_view value, std::string& error) {
+    auto flag = [&](bool& out) {
+        if (value == "true" || value == "yes" || value == "1") out = true;
+        else if (value == "false" || value == "no" || value == "0") out = false;
+        else return false;
+        return true;
+    };
+    bool ok = true;
+    if (key == "name") dataset.name = std::string(value);
+    else if (key == "path") dataset.path = std::string(value);
+    else if (key == "skip_rows") dataset.skipRows = size_t(std::strtoull(std::string(value).c_str(), nullptr, 10));
+    else if (key == "header_row") ok = flag(dataset.headerRow);
+    else if (key == "headers") dataset.headers = splitList(value);
+    else if (key == "delimiter") {
+        if (value == "tab") dataset.delimiter = '\t';
+        else if (value.size() == 1) dataset.delimiter = value[0];
+        else ok = false;
+    } else if (key == "trim") ok = flag(dataset.trimValues);
+    else if (key == "schema") dataset.schema = std::string(value);
+    else if (key == "mode") ok = parseMatchMode(value, dataset.defaultMode);
+    else if (key == "threads") dataset.threads = size_t(std::strtoull(std::string(value).c_str(), nullptr, 10));
+    else {
+        error = "Unknown dataset key " + std::string(key);
+        return false;
+    }
+    if (!ok) error = "Bad value for " + std::string(key) + ": " + std::string(value);
+    return ok;
+}
+
+// Read a descriptor file. A relative path inside it is taken relative to the working directory, like the
+// built-in ones.
+inline bool loadDatasetFile(const std::string& file, DatasetDescriptor& dataset, std::string& error) {
+    std::ifstream in(file);
+    if (!in) {
+        error = "Could not open " + file;
+        return false;
+    }
+    dataset = DatasetDescriptor();
+    dataset.name = std::filesystem::path(file).stem().string();
+    std::string line;
+    while (std::getline(in, line)) {
+        std::string_view text = trimSpaces(line);
+        if (!text.empty() && text.back() == '\r') text = trimSpaces(text.substr(0, text.size() - 1));
+        if (text.empty() || text.front() == '#') continue;
+        size_t equals = text.find('=');
+        if (equals == std::string_view::npos) {
+            error = "Expected key = value in " + file + ": " + std::string(text);
+            return false;
+        }
+        if (!setDatasetField(dataset, trimSpaces(text.substr(0, equals)), trimSpaces(text.substr(equals + 1)), error)) return false;
+    }
+    if (dataset.path.empty()) {
+        error = "No path in " + file;
+        return false;
+    }
+    if (!dataset.headerRow && dataset.headers.empty()) {
+        error = "A dataset without header row needs headers";
+        return false;
+    }
+    return true;
+}
+
+// A built-in name, a descriptor file (*.dataset) or a plain CSV file, directory or glob with default settings
+inline bool resolveDataset(const std::string& spec, DatasetDescriptor& dataset, std::string& error) {
+    if (builtinDataset(spec, dataset)) return true;
+    if (spec.size() > 8 && spec.compare(spec.size() - 8, 8, ".dataset") == 0) return loadDatasetFile(spec, dataset, error);
+    dataset = DatasetDescriptor();
+    dataset.name = spec;
+    dataset.path = spec;
+    return true;
+}
+
+// .csv, or a gzip or zstd compressed .csv
+inline bool hasCsvExtension(const std::string& path) {
+    for (const char* extension : {".csv", ".csv.gz", ".csv.zst"}) {
+        size_t length = std::strlen(extension);
+        if (path.size() >= length && path.compare(path.size() - length, length, extension) == 0) return true;
+    }
+    return false;
+}
+
+// Files of the dataset in path order
+inline std::vector<std::string> datasetFiles(const DatasetDescriptor& dataset) {
+    std::vector<std::string> files;
+    std::error_code ec;
+    if (std::filesystem::is_directory(dataset.path, ec)) {
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(dataset.path, ec)) {
+            if (entry.is_regular_file(ec) && hasCsvExtension(entry.path().string())) files.push_back(entry.path().string());
+        }
+    } else if (dataset.path.find_first_of("*?[") != std::string::npos) {
+        glob_t matches;
+        if (glob(dataset.path.c_str(), 0, nullptr, &matches) == 0) {
+            for (size_t i = 0; i < matches.gl_pathc; ++i) files.push_back(matches.gl_pathv[i]);
+        }
+        globfree(&matches);
+    } else {
+        // an archived copy stands in for a file that was only kept compressed
+        files.push_back(dataset.path);
+        for (const char* extension : {".zst", ".gz"}) {
+            if (std::filesystem::exists(files.back(), ec)) break;
+            if (std::filesystem::exists(dataset.path + extension, ec)) files.back() = dataset.path + extension;
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// Step over the rows in front of the first record of one file. With headers given the header row is read into
+// it (custom headers win over it). Returns false when the file ends first.
+inline bool skipHeaderRows(const DatasetDescriptor& dataset, std::string_view& text, std::vector<std::string>* headers = nullptr) {
+    CsvTokenizer tokenizer(dataset.delimiter);
+    CsvFields fields;
+    for (size_t i = 0; i < dataset.skipRows; ++i) {
+        if (!tokenizer.nextRecord(text, fields)) return false;
+    }
+    if (!dataset.headerRow) {
+        if (headers) *headers = dataset.headers;
+        return true;
+    }
+    if (!tokenizer.nextRecord(text, fields)) return false;
+    if (!headers) return true;
+    if (!dataset.headers.empty()) {
+        *headers = dataset.headers;
+        return true;
+    }
+    headers->clear();
+    for (size_t i = 0; i < fields.size(); ++i) {
+        headers->push_back(std::string(dataset.trimValues ? trimSpaces(fields[i]) : fields[i]));
+    }
+    // a delimiter at the end of every line, as in Data1, leaves an empty last column
+    if (!headers->empty() && headers->back().empty()) headers->pop_back();
+    return true;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Address of a search server: a Unix socket path, or host:port for TCP so that servers on other machines (or
+// several on this one) can be reached the same way. A spec with a ':' and no '/' is a TCP address. An empty
+// host means this machine's loopback interface; "*", 0.0.0.0 or :: listens on every interface, where anyone
+// who can reach the port can search the datasets, so servers only accept such a host when told to.
+
+struct Endpoint {
+    bool tcp = false;
+    std::string path; // Unix socket
+    std::string host;
+    std::string port;
+
+    std::string spec() const { return tcp ? host + ":" + port : path; }
+    bool anyHost() const { return tcp && (host == "*" || host == "0.0.0.0" || host == "::"); }
+};
+
+inline bool parseEndpoint(const std::string& spec, Endpoint& endpoint, std::string& error) {
+    endpoint = Endpoint();
+    size_t colon = spec.rfind(':');
+    if (colon == std::string::npos || spec.find('/') != std::string::npos) {
+        sockaddr_un address;
+        if (spec.empty() || spec.size() >= sizeof(address.sun_path)) {
+            error = "Bad socket path " + spec;
+            return false;
+        }
+        endpoint.path = spec;
+        return true;
+    }
+    endpoint.tcp = true;
+    endpoint.host = spec.substr(0, colon);
+    endpoint.port = spec.substr(colon + 1);
+    if (endpoint.port.empty() || endpoint.port.find_first_not_of("0123456789") != std::string::npos) {
+        error = "Bad port in " + spec;
+        return false;
+    }
+    return true;
+}
+
+// Bound and listening socket, -1 on failure
+inline int listenOn(const Endpoint& endpoint, int backlog = 64) {
+    if (!endpoint.tcp) {
+        int server = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, endpoint.path.c_str(), sizeof(address.sun_path) - 1);
+        unlink(endpoint.path.c_str());
+        if (server < 0 || bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(server, backlog) != 0) {
+            if (server >= 0) close(server);
+            return -1;
+        }
+        return server;
+    }
+    // a wildcard host takes the passive addresses, no host the IPv4 loopback that every client's localhost reaches
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* addresses = nullptr;
+    const char* host = endpoint.anyHost() ? nullptr : endpoint.host.empty() ? "127.0.0.1" : endpoint.host.c_str();
+    if (getaddrinfo(host, endpoint.port.c_str(), &hints, &addresses) != 0) return -1;
+    int server = -1;
+    for (addrinfo* a = addresses; a && server < 0; a = a->ai_next) {
+        server = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+        if (server < 0) continue;
+        int on = 1;
+        setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(server, a->ai_addr, a->ai_addrlen) != 0 || listen(server, backlog) != 0) {
+            close(server);
+            server = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    return server;
+}
+
+// Requests and answers are single writes, nothing to coalesce
+inline void disableNagle(int fd) {
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+// Next client of a listening socket, -1 on a failed accept
+inline int acceptClient(int server, const Endpoint& endpoint) {
+    int client = accept4(server, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client >= 0 && endpoint.tcp) disableNagle(client);
+    return client;
+}
+
+// Connected socket, -1 when nobody listens there
+inline int connectTo(const Endpoint& endpoint) {
+    if (!endpoint.tcp) {
+        int client = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, endpoint.path.c_str(), sizeof(address.sun_path) - 1);
+        if (client >= 0 && connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) return client;
+        if (client >= 0) close(client);
+        return -1;
+    }
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    bool local = endpoint.host.empty() || endpoint.anyHost();
+    if (getaddrinfo(local ? "localhost" : endpoint.host.c_str(), endpoint.port.c_str(), &hints, &addresses) != 0) return -1;
+    int client = -1;
+    for (addrinfo* a = addresses; a && client < 0; a = a->ai_next) {
+        client = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+        if (client < 0) continue;
+        if (connect(client, a->ai_addr, a->ai_addrlen) != 0) {
+            close(client);
+            client = -1;
+            continue;
+        }
+        disableNagle(client);
+    }
+    freeaddrinfo(addresses);
+    return client;
+}
+
+inline bool writeAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t n = write(fd, data.data(), data.size());
+        if (n <= 0) return false;
+        data.remove_prefix(size_t(n));
+    }
+    return true;
+}
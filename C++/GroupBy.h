@@ -0,0 +1,273 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "CsvTokenizer.h"
+#include "CsvIndex.h"
+#include "QueryEngine.h"
+#include "ResultSink.h"
+#include "TypedColumns.h"
+
+// Group-by aggregation over one key column. Every thread folds its byte ranges into its own open-addressing
+// GroupTable (key text in a private arena, aggregate state inline), so the scan shares nothing; the partial
+// tables are merged once the parallel region ends and only the groups leave the process.
+
+enum class AggregateOp { Count, Sum, Min, Max, Avg };
+
+struct AggregateSpec {
+    AggregateOp op = AggregateOp::Count;
+    size_t column = 0; // value column, unused for count
+    size_t slot = 0;   // index of the column among GroupSpec::valueColumns
+    std::string label; // "count", "sum(col)", ...
+};
+
+struct GroupSpec {
+    size_t keyColumn = 0;
+    std::vector<AggregateSpec> aggregates;
+    std::vector<size_t> valueColumns; // distinct columns the aggregates read
+};
+
+// Parse "count,sum:<header>,avg:<header>,..." (empty means count)
+inline bool parseGroupSpec(std::string_view keyHeader, std::string_view aggregates, const std::vector<std::string>& headers,
+                           GroupSpec& spec, std::string& error) {
+    spec = GroupSpec();
+    spec.keyColumn = std::find(headers.begin(), headers.end(), keyHeader) - headers.begin();
+    if (spec.keyColumn == headers.size()) {
+        error = "Unknown header " + std::string(keyHeader);
+        return false;
+    }
+    if (aggregates.empty()) aggregates = "count";
+    while (!aggregates.empty()) {
+        size_t comma = aggregates.find(',');
+        std::string_view item = aggregates.substr(0, comma);
+        aggregates = comma == std::string_view::npos ? std::string_view() : aggregates.substr(comma + 1);
+
+        AggregateSpec aggregate;
+        size_t colon = item.find(':');
+        std::string_view name = item.substr(0, colon);
+        if (name == "count") aggregate.op = AggregateOp::Count;
+        else if (name == "sum") aggregate.op = AggregateOp::Sum;
+        else if (name == "min") aggregate.op = AggregateOp::Min;
+        else if (name == "max") aggregate.op = AggregateOp::Max;
+        else if (name == "avg") aggregate.op = AggregateOp::Avg;
+        else {
+            error = "Unknown aggregate " + std::string(item);
+            return false;
+        }
+        if (aggregate.op == AggregateOp::Count) {
+            aggregate.label = "count";
+        } else {
+            std::string_view header = colon == std::string_view::npos ? std::string_view() : item.substr(colon + 1);
+            aggregate.column = std::find(headers.begin(), headers.end(), header) - headers.begin();
+            if (aggregate.column == headers.size()) {
+                error = "Unknown header " + std::string(header) + " in " + std::string(item);
+                return false;
+            }
+            aggregate.slot = std::find(spec.valueColumns.begin(), spec.valueColumns.end(), aggregate.column) - spec.valueColumns.begin();
+            if (aggregate.slot == spec.valueColumns.size()) spec.valueColumns.push_back(aggregate.column);
+            aggregate.label = std::string(name) + "(" + std::string(header) + ")";
+        }
+        spec.aggregates.push_back(aggregate);
+    }
+    return true;
+}
+
+// Running sum/min/max over the numeric cells of one value column; cells that are not numbers are skipped
+struct AggregateState {
+    double sum = 0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    uint64_t count = 0;
+
+    void add(double value) {
+        sum += value;
+        min = std::min(min, value);
+        max = std::max(max, value);
+        ++count;
+    }
+
+    void merge(const AggregateState& other) {
+        sum += other.sum;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        count += other.count;
+    }
+};
+
+class GroupTable {
+public:
+    explicit GroupTable(size_t valueColumns = 0) : width_(valueColumns), slots_(1024, emptyGroup) {}
+
+    size_t size() const { return keys_.size(); }
+    std::string_view key(size_t group) const { return std::string_view(arena_.data() + keys_[group].offset, keys_[group].length); }
+    uint64_t rows(size_t group) const { return rows_[group]; }
+    const AggregateState& state(size_t group, size_t slot) const { return states_[group * width_ + slot]; }
+
+    // Group of key, created on first sight
+    size_t group(std::string_view key, uint64_t hash) {
+        size_t mask = slots_.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            uint32_t group = slots_[i];
+            if (group == emptyGroup) {
+                group = uint32_t(keys_.size());
+                slots_[i] = group;
+                keys_.push_back({hash, arena_.size(), uint32_t(key.size())});
+                arena_.append(key);
+                rows_.push_back(0);
+                states_.resize(states_.size() + width_);
+                if (keys_.size() * 2 > slots_.size()) grow();
+                return group;
+            }
+            if (keys_[group].hash == hash && this->key(group) == key) return group;
+        }
+    }
+
+    void addRow(size_t group) { ++rows_[group]; }
+    AggregateState& state(size_t group, size_t slot) { return states_[group * width_ + slot]; }
+
+    void merge(const GroupTable& other) {
+        for (size_t g = 0; g < other.size(); ++g) {
+            size_t mine = group(other.key(g), other.keys_[g].hash);
+            rows_[mine] += other.rows_[g];
+            for (size_t s = 0; s < width_; ++s) state(mine, s).merge(other.state(g, s));
+        }
+    }
+
+private:
+    static constexpr uint32_t emptyGroup = ~uint32_t(0);
+
+    struct Key {
+        uint64_t hash;
+        size_t offset;
+        uint32_t length;
+    };
+
+    void grow() {
+        std::vector<uint32_t> slots(slots_.size() * 2, emptyGroup);
+        size_t mask = slots.size() - 1;
+        for (uint32_t g = 0; g < keys_.size(); ++g) {
+            size_t i = keys_[g].hash & mask;
+            while (slots[i] != emptyGroup) i = (i + 1) & mask;
+            slots[i] = g;
+        }
+        slots_.swap(slots);
+    }
+
+    size_t width_;
+    std::vector<uint32_t> slots_; // group number per slot, power of two sized
+    std::vector<Key> keys_;
+    std::string arena_;
+    std::vector<uint64_t> rows_;
+    std::vector<AggregateState> states_; // width_ per group
+};
+
+// Fold every record of text, or only those matching filter, into table. The record buffers are scratch memory
+// of the calling thread, the table itself is not. Updating the table counts as the materialize stage. trim groups
+// and filters the cells without the spaces around them.
+inline void aggregateRecords(std::string_view text, const GroupSpec& spec, GroupTable& table, const QueryNode* filter = nullptr,
+                             char delimiter = ',', bool trim = false) {
+    ScratchScope scratch;
+    CsvTokenizer tokenizer(delimiter);
+    RecordProbe probe;
+    CsvFields fields(scratch.arena());
+    StageTimer timer;
+    // plain counts only need the key column, everything else splits the record
+    if (!filter && spec.valueColumns.empty()) {
+        while (!text.empty()) {
+            tokenizer.probeRecord(text, spec.keyColumn, probe);
+            if (!probe.hasField) continue;
+            std::string_view key;
+            if (!unquotedView(trim ? trimSpaces(probe.field) : probe.field, key)) {
+                tokenizer.splitLine(probe.record, fields);
+                key = trim ? trimSpaces(fields[spec.keyColumn]) : fields[spec.keyColumn];
+            }
+            timer.lap(Stage::Tokenize);
+            table.addRow(table.group(key, hashValue(key)));
+            timer.lap(Stage::Materialize);
+        }
+        return;
+    }
+
+    std::optional<QueryEvaluator> evaluator;
+    if (filter) evaluator.emplace(*filter, scratch.arena(), delimiter, trim);
+    std::string_view record;
+    while (!text.empty()) {
+        const CsvFields* row = &fields;
+        if (evaluator) {
+            if (!evaluator->next(text, record, &timer)) continue;
+            row = &evaluator->fields();
+        } else {
+            tokenizer.nextRecord(text, fields);
+            timer.lap(Stage::Tokenize);
+        }
+        if (spec.keyColumn >= row->size()) continue;
+        std::string_view key = trim ? trimSpaces((*row)[spec.keyColumn]) : (*row)[spec.keyColumn];
+        size_t group = table.group(key, hashValue(key));
+        table.addRow(group);
+        for (size_t s = 0; s < spec.valueColumns.size(); ++s) {
+            double value;
+            if (spec.valueColumns[s] < row->size() && parseNumber((*row)[spec.valueColumns[s]], ColumnType::Float, value)) {
+                table.state(group, s).add(value);
+            }
+        }
+        timer.lap(Stage::Materialize);
+    }
+}
+
+inline std::string formatAggregate(double value) {
+    if (value == double(int64_t(value)) && std::abs(value) < 1e15) return std::to_string(int64_t(value));
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.10g", value);
+    return buffer;
+}
+
+// Print the merged groups, largest first, as "key: value | count: n | ..." text, NDJSON or CSV
+inline std::string formatGroups(const GroupTable& table, const GroupSpec& spec, const std::vector<std::string>& headers,
+                                OutputFormat format) {
+    std::vector<size_t> order(table.size());
+    for (size_t g = 0; g < order.size(); ++g) order[g] = g;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return table.rows(a) != table.rows(b) ? table.rows(a) > table.rows(b) : table.key(a) < table.key(b);
+    });
+
+    std::vector<std::string> columns = {headers[spec.keyColumn]};
+    for (const AggregateSpec& aggregate : spec.aggregates) columns.push_back(aggregate.label);
+    std::string out = format == OutputFormat::Csv ? csvHeaderLine(columns) : std::string();
+    std::vector<std::string> cells(columns.size());
+    for (size_t g : order) {
+        cells[0] = std::string(table.key(g));
+        for (size_t a = 0; a < spec.aggregates.size(); ++a) {
+            const AggregateSpec& aggregate = spec.aggregates[a];
+            if (aggregate.op == AggregateOp::Count) {
+                cells[a + 1] = std::to_string(table.rows(g));
+                continue;
+            }
+            const AggregateState& state = table.state(g, aggregate.slot);
+            if (state.count == 0) {
+                cells[a + 1].clear();
+            } else if (aggregate.op == AggregateOp::Sum) {
+                cells[a + 1] = formatAggregate(state.sum);
+            } else if (aggregate.op == AggregateOp::Min) {
+                cells[a + 1] = formatAggregate(state.min);
+            } else if (aggregate.op == AggregateOp::Max) {
+                cells[a + 1] = formatAggregate(state.max);
+            } else {
+                cells[a + 1] = formatAggregate(state.sum / double(state.count));
+            }
+        }
+        if (format != OutputFormat::Text) {
+            appendRow(out, format, columns, columns.size(), [&](size_t i) { return std::string_view(cells[i]); });
+            continue;
+        }
+        for (size_t i = 0; i < columns.size(); ++i) out.append(columns[i]).append(": ").append(cells[i]).append(" | ");
+        out += '\n';
+    }
+    return out;
+}
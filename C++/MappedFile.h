@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only memory mapping of a whole file. The mapping is released when the object goes out of scope,
+// so string_views handed out by view() must not outlive it.
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ > 0) {
+            void* addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) {
+                ::close(fd);
+                size_ = 0;
+                return false;
+            }
+            data_ = static_cast<const char*>(addr);
+            // every thread walks its own range front to back
+            madvise(addr, size_, MADV_SEQUENTIAL);
+        }
+        ::close(fd);
+        return true;
+    }
+
+    void close() {
+        if (data_) munmap(const_cast<char*>(data_), size_);
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    std::string_view view() const { return std::string_view(data_ ? data_ : "", size_); }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Write side of the sidecar files: write(out) fills a temporary file next to path, which is then renamed over
+// it, so readers see the old or the new file whole. The temporary name is unique to the process and the call,
+// so concurrent builders of the same file never write into each other's; the last rename wins.
+template <class WriteFn>
+bool replaceFile(const std::string& path, WriteFn write) {
+    static std::atomic<unsigned> serial{0};
+    std::string tmpPath = path + ".tmp" + std::to_string(getpid()) + "." + std::to_string(serial.fetch_add(1));
+    FILE* out = std::fopen(tmpPath.c_str(), "wbx");
+    if (!out) return false;
+    bool ok = write(out);
+    ok = (std::fclose(out) == 0) && ok;
+    if (!ok || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Pop the next line off the front of text (without the trailing "\n" or "\r\n")
+inline bool nextLine(std::string_view& text, std::string_view& line) {
+    if (text.empty()) return false;
+    size_t pos = text.find('\n');
+    if (pos == std::string_view::npos) {
+        line = text;
+        text = std::string_view();
+    } else {
+        line = text.substr(0, pos);
+        text.remove_prefix(pos + 1);
+    }
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    return true;
+}
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "CsvTokenizer.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Prefix, substring and case-insensitive searches, for one term or any of several. Instead of probing every
+// record, a SIMD filter runs over the raw buffer: for every term the bytes at i and i+n-1 are compared with its
+// first and last byte 16 or 32 positions at a time, and only the positions where both agree are compared in
+// full. Records in front of the next hit are stepped over with the quote-aware newline scan, and the searched
+// field of the record holding the hit is then matched as a whole. Case folding is ASCII only.
+
+enum class MatchKind { Exact, Prefix, Contains };
+
+inline bool parseMatchKind(std::string_view name, MatchKind& kind) {
+    if (name == "exact") kind = MatchKind::Exact;
+    else if (name == "prefix") kind = MatchKind::Prefix;
+    else if (name == "contains") kind = MatchKind::Contains;
+    else return false;
+    return true;
+}
+
+inline const char* matchKindName(MatchKind kind) {
+    switch (kind) {
+        case MatchKind::Prefix: return "prefix";
+        case MatchKind::Contains: return "contains";
+        default: return "exact";
+    }
+}
+
+inline bool isAsciiLetter(char c) { return (c | 0x20) >= 'a' && (c | 0x20) <= 'z'; }
+inline char foldCase(char c) { return c >= 'A' && c <= 'Z' ? char(c | 0x20) : c; }
+
+inline bool equalsFolded(const char* a, const char* b, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        if (foldCase(a[i]) != foldCase(b[i])) return false;
+    }
+    return true;
+}
+
+struct PatternTerm {
+    std::string text;
+    char first = 0;
+    char last = 0;
+    bool foldFirst = false; // the byte is a letter and compared either case
+    bool foldLast = false;
+};
+
+class PatternMatcher;
+using CandidateFn = size_t (*)(const PatternMatcher& matcher, std::string_view text, size_t from);
+
+class PatternMatcher {
+public:
+    PatternMatcher() = default;
+
+    // terms holds one term, or several separated by '|' when anyOf is set
+    PatternMatcher(std::string_view terms, MatchKind kind, bool ignoreCase, bool anyOf, char delimiter = ',',
+                   ScanKernel kernel = detectScanKernel())
+        : kind_(kind), ignoreCase_(ignoreCase) {
+        while (true) {
+            size_t bar = anyOf ? terms.find('|') : std::string_view::npos;
+            addTerm(terms.substr(0, bar));
+            if (bar == std::string_view::npos) break;
+            terms.remove_prefix(bar + 1);
+        }
+        // a term with bytes that the raw file may spell differently, or that span fields, cannot be looked for
+        // in the raw buffer; every record is then a candidate
+        rawSearchable_ = true;
+        for (const PatternTerm& term : terms_) {
+            rawSearchable_ = rawSearchable_ && !term.text.empty() && term.text.find_first_of(std::string("\"\r\n") + delimiter) == std::string::npos;
+        }
+        candidate_ = candidateFor(kernel);
+    }
+
+    const std::vector<PatternTerm>& terms() const { return terms_; }
+    MatchKind kind() const { return kind_; }
+    bool ignoreCase() const { return ignoreCase_; }
+
+    // A search that only needs the exact comparison (and the sidecar index) of the plain search
+    bool plainEquality() const { return kind_ == MatchKind::Exact && !ignoreCase_ && terms_.size() == 1; }
+
+    // Does the (unquoted) cell match one of the terms as a whole
+    bool matches(std::string_view cell) const {
+        for (const PatternTerm& term : terms_) {
+            if (matchesTerm(cell, term.text)) return true;
+        }
+        return false;
+    }
+
+    // Position of the first occurrence of any term in text at or after from, npos when there is none. Without a
+    // raw filter every position is a candidate.
+    size_t nextCandidate(std::string_view text, size_t from) const {
+        if (!rawSearchable_) return from < text.size() ? from : std::string_view::npos;
+        return candidate_(*this, text, from);
+    }
+
+    // Does a term start at text[pos]
+    bool termAt(std::string_view text, size_t pos) const {
+        for (const PatternTerm& term : terms_) {
+            if (pos + term.text.size() <= text.size() && compare(text.data() + pos, term.text.data(), term.text.size())) return true;
+        }
+        return false;
+    }
+
+private:
+    void addTerm(std::string_view text) {
+        PatternTerm term;
+        term.text = std::string(text);
+        if (!text.empty()) {
+            term.first = text.front();
+            term.last = text.back();
+            term.foldFirst = ignoreCase_ && isAsciiLetter(term.first);
+            term.foldLast = ignoreCase_ && isAsciiLetter(term.last);
+            if (term.foldFirst) term.first = char(term.first | 0x20);
+            if (term.foldLast) term.last = char(term.last | 0x20);
+        }
+        terms_.push_back(term);
+    }
+
+    bool compare(const char* a, const char* b, size_t n) const { return ignoreCase_ ? equalsFolded(a, b, n) : std::memcmp(a, b, n) == 0; }
+
+    bool matchesTerm(std::string_view cell, std::string_view term) const {
+        if (kind_ == MatchKind::Exact) return cell.size() == term.size() && compare(cell.data(), term.data(), term.size());
+        if (cell.size() < term.size()) return false;
+        if (kind_ == MatchKind::Prefix) return compare(cell.data(), term.data(), term.size());
+        for (size_t i = 0; i + term.size() <= cell.size(); ++i) {
+            if (compare(cell.data() + i, term.data(), term.size())) return true;
+        }
+        return false;
+    }
+
+    static CandidateFn candidateFor(ScanKernel kernel);
+
+    std::vector<PatternTerm> terms_;
+    MatchKind kind_ = MatchKind::Exact;
+    bool ignoreCase_ = false;
+    bool rawSearchable_ = false;
+    CandidateFn candidate_ = nullptr;
+};
+
+inline bool firstLastMatch(const PatternTerm& term, const char* p) {
+    char first = term.foldFirst ? char(p[0] | 0x20) : p[0];
+    char last = term.foldLast ? char(p[term.text.size() - 1] | 0x20) : p[term.text.size() - 1];
+    return first == term.first && last == term.last;
+}
+
+inline size_t findCandidateScalar(const PatternMatcher& matcher, std::string_view text, size_t from) {
+    for (size_t pos = from; pos < text.size(); ++pos) {
+        for (const PatternTerm& term : matcher.terms()) {
+            if (pos + term.text.size() <= text.size() && firstLastMatch(term, text.data() + pos) && matcher.termAt(text, pos)) return pos;
+        }
+    }
+    return std::string_view::npos;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// One vector compare per term and end byte; letters are compared with the case bit set on both sides, which
+// lets a few punctuation bytes through as well, the full comparison drops them
+__attribute__((target("sse2"))) inline size_t findCandidateSse2(const PatternMatcher& matcher, std::string_view text, size_t from) {
+    size_t longest = 0;
+    for (const PatternTerm& term : matcher.terms()) longest = std::max(longest, term.text.size());
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    size_t pos = from;
+    for (; pos + 16 + longest - 1 <= text.size(); pos += 16) {
+        uint32_t mask = 0;
+        for (const PatternTerm& term : matcher.terms()) {
+            __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + pos));
+            __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + pos + term.text.size() - 1));
+            if (term.foldFirst) head = _mm_or_si128(head, caseBit);
+            if (term.foldLast) tail = _mm_or_si128(tail, caseBit);
+            __m128i both = _mm_and_si128(_mm_cmpeq_epi8(head, _mm_set1_epi8(term.first)), _mm_cmpeq_epi8(tail, _mm_set1_epi8(term.last)));
+            mask |= uint32_t(_mm_movemask_epi8(both));
+        }
+        while (mask) {
+            int bit = __builtin_ctz(mask);
+            mask &= mask - 1;
+            if (matcher.termAt(text, pos + size_t(bit))) return pos + size_t(bit);
+        }
+    }
+    return findCandidateScalar(matcher, text, pos);
+}
+
+__attribute__((target("avx2"))) inline size_t findCandidateAvx2(const PatternMatcher& matcher, std::string_view text, size_t from) {
+    size_t longest = 0;
+    for (const PatternTerm& term : matcher.terms()) longest = std::max(longest, term.text.size());
+    const __m256i caseBit = _mm256_set1_epi8(0x20);
+    size_t pos = from;
+    for (; pos + 32 + longest - 1 <= text.size(); pos += 32) {
+        uint32_t mask = 0;
+        for (const PatternTerm& term : matcher.terms()) {
+            __m256i head = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + pos));
+            __m256i tail = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + pos + term.text.size() - 1));
+            if (term.foldFirst) head = _mm256_or_si256(head, caseBit);
+            if (term.foldLast) tail = _mm256_or_si256(tail, caseBit);
+            __m256i both = _mm256_and_si256(_mm256_cmpeq_epi8(head, _mm256_set1_epi8(term.first)),
+                                            _mm256_cmpeq_epi8(tail, _mm256_set1_epi8(term.last)));
+            mask |= uint32_t(_mm256_movemask_epi8(both));
+        }
+        while (mask) {
+            int bit = __builtin_ctz(mask);
+            mask &= mask - 1;
+            if (matcher.termAt(text, pos + size_t(bit))) return pos + size_t(bit);
+        }
+    }
+    return findCandidateScalar(matcher, text, pos);
+}
+#endif
+
+inline CandidateFn PatternMatcher::candidateFor(ScanKernel kernel) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (kernel == ScanKernel::Avx2) return findCandidateAvx2;
+    if (kernel == ScanKernel::Sse2) return findCandidateSse2;
+#endif
+    (void)kernel;
+    return findCandidateScalar;
+}
+
+// Call onMatch(record) for every record of text, which starts on a record boundary, whose field column matches;
+// onMatch returns false to stop, stop is checked once per hit. Records that end before the next raw hit are
+// skipped without being split. Cells are unquoted, and trimmed of spaces when trim is set.
+template <class OnMatch>
+void findPatternRecords(const CsvTokenizer& tokenizer, const PatternMatcher& matcher, std::string_view text, size_t column, bool trim,
+                        CsvFields& row, OnMatch onMatch, const std::atomic<bool>* stop = nullptr) {
+    RecordProbe probe;
+    size_t hit = matcher.nextCandidate(text, 0);
+    while (hit != std::string_view::npos && !(stop && stop->load(std::memory_order_relaxed))) {
+        size_t skip = tokenizer.lastRecordEnd(text.substr(0, hit));
+        text.remove_prefix(skip);
+        size_t before = text.size();
+        tokenizer.probeRecord(text, column, probe);
+        size_t consumed = before - text.size();
+        // the next hit is searched for past this record only
+        hit = hit - skip < consumed ? matcher.nextCandidate(text, 0) : matcher.nextCandidate(text, hit - skip - consumed);
+        if (!probe.hasField) continue;
+
+        std::string_view cell = probe.field;
+        if (cell.size() >= 2 && cell.front() == '"' && cell.back() == '"') {
+            cell = cell.substr(1, cell.size() - 2);
+            if (cell.find('"') != std::string_view::npos) {
+                tokenizer.splitLine(probe.record, row);
+                cell = row[column];
+            }
+        }
+        if (trim) {
+            while (!cell.empty() && cell.front() == ' ') cell.remove_prefix(1);
+            while (!cell.empty() && cell.back() == ' ') cell.remove_suffix(1);
+        }
+        if (matcher.matches(cell) && !onMatch(probe.record)) return;
+    }
+}
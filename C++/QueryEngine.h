@@ -0,0 +1,316 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "CsvTokenizer.h"
+#include "Dataset.h"
+#include "StageStats.h"
+#include "TypedColumns.h"
+
+// Multi-predicate queries evaluated in a single pass. An expression such as
+//     Plate ID=KGL8099 AND (Issue Date^=03/ OR Issue Date^=04/)
+// is parsed into a predicate tree whose headers are resolved to columns once. The children of every AND/OR are
+// reordered cheapest first so evaluation short-circuits early, and the first leaf is evaluated on a probe of a
+// single column; a record is only split completely when more leaves have to look at it.
+//
+// Leaf operators: = and != (exact text), ^= (starts with), $= (ends with), *= (contains) and the numeric
+// comparisons < <= > >=. Values may be double quoted to keep spaces, parentheses or the words AND/OR.
+
+enum class QueryOp { Equal, NotEqual, Prefix, Suffix, Contains, Less, LessEqual, Greater, GreaterEqual };
+
+struct QueryNode {
+    enum class Kind { And, Or, Leaf };
+    Kind kind = Kind::Leaf;
+    std::vector<std::unique_ptr<QueryNode>> children;
+
+    // leaf only
+    size_t column = 0;
+    QueryOp op = QueryOp::Equal;
+    std::string value;
+    double number = 0;
+
+    double cost = 0; // estimated evaluation cost of the subtree, set by optimizeQuery
+};
+
+// Strip the quotes of a raw field when that needs no copy, false when it holds "" escapes
+inline bool unquotedView(std::string_view raw, std::string_view& value) {
+    if (raw.size() < 2 || raw.front() != '"' || raw.back() != '"') {
+        value = raw;
+        return true;
+    }
+    value = raw.substr(1, raw.size() - 2);
+    return value.find('"') == std::string_view::npos;
+}
+
+inline bool evaluateLeaf(const QueryNode& leaf, std::string_view cell) {
+    switch (leaf.op) {
+        case QueryOp::Equal: return cell == leaf.value;
+        case QueryOp::NotEqual: return cell != leaf.value;
+        case QueryOp::Prefix: return cell.substr(0, leaf.value.size()) == leaf.value;
+        case QueryOp::Suffix: return cell.size() >= leaf.value.size() && cell.substr(cell.size() - leaf.value.size()) == leaf.value;
+        case QueryOp::Contains: return cell.find(leaf.value) != std::string_view::npos;
+        default: break;
+    }
+    double number;
+    if (!parseNumber(cell, ColumnType::Float, number)) return false;
+    switch (leaf.op) {
+        case QueryOp::Less: return number < leaf.number;
+        case QueryOp::LessEqual: return number <= leaf.number;
+        case QueryOp::Greater: return number > leaf.number;
+        default: return number >= leaf.number;
+    }
+}
+
+class QueryParser {
+public:
+    QueryParser(std::string_view text, const std::vector<std::string>& headers) : text_(text), headers_(headers) {}
+
+    std::unique_ptr<QueryNode> parse(std::string& error) {
+        std::unique_ptr<QueryNode> root = parseOr();
+        skipSpaces();
+        if (root && pos_ < text_.size()) fail("Unexpected '" + std::string(text_.substr(pos_)) + "'");
+        if (!error_.empty()) {
+            error = error_;
+            return nullptr;
+        }
+        return root;
+    }
+
+private:
+    std::unique_ptr<QueryNode> parseOr() {
+        return parseList(QueryNode::Kind::Or, "OR", "||", &QueryParser::parseAnd);
+    }
+
+    std::unique_ptr<QueryNode> parseAnd() {
+        return parseList(QueryNode::Kind::And, "AND", "&&", &QueryParser::parsePrimary);
+    }
+
+    std::unique_ptr<QueryNode> parseList(QueryNode::Kind kind, std::string_view word, std::string_view symbol,
+                                         std::unique_ptr<QueryNode> (QueryParser::*parseChild)()) {
+        std::unique_ptr<QueryNode> first = (this->*parseChild)();
+        if (!first) return nullptr;
+        auto node = std::make_unique<QueryNode>();
+        node->kind = kind;
+        node->children.push_back(std::move(first));
+        while (acceptKeyword(word, symbol)) {
+            std::unique_ptr<QueryNode> next = (this->*parseChild)();
+            if (!next) return nullptr;
+            node->children.push_back(std::move(next));
+        }
+        if (node->children.size() == 1) return std::move(node->children[0]);
+        return node;
+    }
+
+    std::unique_ptr<QueryNode> parsePrimary() {
+        skipSpaces();
+        if (pos_ < text_.size() && text_[pos_] == '(') {
+            ++pos_;
+            std::unique_ptr<QueryNode> inner = parseOr();
+            skipSpaces();
+            if (!inner) return nullptr;
+            if (pos_ >= text_.size() || text_[pos_] != ')') return fail("Missing ')'");
+            ++pos_;
+            return inner;
+        }
+
+        // header runs up to the operator, it may contain spaces
+        size_t opPos = text_.find_first_of("=!^$*<>", pos_);
+        if (opPos == std::string_view::npos) return fail("Missing operator in '" + std::string(text_.substr(pos_)) + "'");
+        std::string_view header = trimSpaces(text_.substr(pos_, opPos - pos_));
+        auto leaf = std::make_unique<QueryNode>();
+        leaf->column = std::find(headers_.begin(), headers_.end(), header) - headers_.begin();
+        if (leaf->column == headers_.size()) return fail("Unknown header " + std::string(header));
+
+        static const std::pair<std::string_view, QueryOp> ops[] = {
+            {"!=", QueryOp::NotEqual}, {"^=", QueryOp::Prefix}, {"$=", QueryOp::Suffix}, {"*=", QueryOp::Contains},
+            {"<=", QueryOp::LessEqual}, {">=", QueryOp::GreaterEqual}, {"=", QueryOp::Equal}, {"<", QueryOp::Less},
+            {">", QueryOp::Greater}};
+        pos_ = opPos;
+        bool known = false;
+        for (const auto& op : ops) {
+            if (text_.substr(pos_, op.first.size()) == op.first) {
+                leaf->op = op.second;
+                pos_ += op.first.size();
+                known = true;
+                break;
+            }
+        }
+        if (!known) return fail("Unknown operator after " + std::string(header));
+
+        if (!parseValue(leaf->value)) return nullptr;
+        if (leaf->op >= QueryOp::Less && !parseNumber(leaf->value, ColumnType::Float, leaf->number)) {
+            return fail("Bad number " + leaf->value);
+        }
+        return leaf;
+    }
+
+    // quoted value, or everything up to the next AND/OR/&&/|| or ')'
+    bool parseValue(std::string& value) {
+        skipSpaces();
+        if (pos_ < text_.size() && text_[pos_] == '"') {
+            size_t close = text_.find('"', pos_ + 1);
+            if (close == std::string_view::npos) {
+                fail("Missing closing quote");
+                return false;
+            }
+            value = std::string(text_.substr(pos_ + 1, close - pos_ - 1));
+            pos_ = close + 1;
+            return true;
+        }
+        size_t end = pos_;
+        while (end < text_.size() && text_[end] != ')' && !keywordAt(end)) ++end;
+        value = std::string(trimSpaces(text_.substr(pos_, end - pos_)));
+        pos_ = end;
+        return true;
+    }
+
+    // a keyword only counts as a whole word preceded by a space
+    bool keywordAt(size_t at) const {
+        if (text_.substr(at, 2) == "&&" || text_.substr(at, 2) == "||") return true;
+        if (at == 0 || text_[at - 1] != ' ') return false;
+        for (std::string_view word : {std::string_view("AND"), std::string_view("OR")}) {
+            if (text_.substr(at, word.size()) == word &&
+                (at + word.size() == text_.size() || text_[at + word.size()] == ' ' || text_[at + word.size()] == '(')) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool acceptKeyword(std::string_view word, std::string_view symbol) {
+        skipSpaces();
+        for (std::string_view token : {word, symbol}) {
+            if (text_.substr(pos_, token.size()) == token) {
+                size_t after = pos_ + token.size();
+                if (token == word && after < text_.size() && text_[after] != ' ' && text_[after] != '(') continue;
+                pos_ = after;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void skipSpaces() {
+        while (pos_ < text_.size() && text_[pos_] == ' ') ++pos_;
+    }
+
+    static std::string_view trimSpaces(std::string_view s) {
+        while (!s.empty() && s.front() == ' ') s.remove_prefix(1);
+        while (!s.empty() && s.back() == ' ') s.remove_suffix(1);
+        return s;
+    }
+
+    std::unique_ptr<QueryNode> fail(std::string message) {
+        if (error_.empty()) error_ = std::move(message);
+        pos_ = text_.size();
+        return nullptr;
+    }
+
+    std::string_view text_;
+    const std::vector<std::string>& headers_;
+    size_t pos_ = 0;
+    std::string error_;
+};
+
+// Cost of a leaf: exact comparisons are cheapest and most selective, substring searches and number parsing
+// cost more. Children of AND/OR are sorted by the cost of their subtree so the cheap checks short-circuit
+// the expensive ones.
+inline double optimizeQuery(QueryNode& node) {
+    if (node.kind == QueryNode::Kind::Leaf) {
+        switch (node.op) {
+            case QueryOp::Equal: case QueryOp::NotEqual: node.cost = 1; break;
+            case QueryOp::Prefix: case QueryOp::Suffix: node.cost = 1.5; break;
+            case QueryOp::Contains: node.cost = 3; break;
+            default: node.cost = 4; break;
+        }
+        return node.cost;
+    }
+    node.cost = 0;
+    for (auto& child : node.children) node.cost += optimizeQuery(*child);
+    std::stable_sort(node.children.begin(), node.children.end(),
+                     [](const std::unique_ptr<QueryNode>& a, const std::unique_ptr<QueryNode>& b) { return a->cost < b->cost; });
+    return node.cost;
+}
+
+inline std::unique_ptr<QueryNode> parseQuery(std::string_view text, const std::vector<std::string>& headers, std::string& error) {
+    std::unique_ptr<QueryNode> root = QueryParser(text, headers).parse(error);
+    if (root) optimizeQuery(*root);
+    return root;
+}
+
+// Equality leaf that every match must satisfy (the root or a child of a root AND), usable for index lookups
+inline const QueryNode* requiredEquality(const QueryNode& root) {
+    if (root.kind == QueryNode::Kind::Leaf) return root.op == QueryOp::Equal ? &root : nullptr;
+    if (root.kind != QueryNode::Kind::And) return nullptr;
+    for (const auto& child : root.children) {
+        if (child->kind == QueryNode::Kind::Leaf && child->op == QueryOp::Equal) return child.get();
+    }
+    return nullptr;
+}
+
+// Evaluates a query tree record by record. The first leaf in evaluation order only needs its own column, so
+// records are cut with a probe of that column and split completely only when the outcome is still open.
+class QueryEvaluator {
+public:
+    // trim compares the cells without the spaces around them, as searches on a trimmed dataset do
+    explicit QueryEvaluator(const QueryNode& root, Arena* arena = nullptr, char delimiter = ',', bool trim = false)
+        : root_(root), driver_(&root), tokenizer_(delimiter), fields_(arena), trim_(trim) {
+        while (driver_->kind != QueryNode::Kind::Leaf) driver_ = driver_->children.front().get();
+    }
+
+    // Pop the next record off text and evaluate the query on it; record is set either way. With a timer the
+    // probe is charged to tokenize and the evaluation, splits included, to filter.
+    bool next(std::string_view& text, std::string_view& record, StageTimer* timer = nullptr) {
+        tokenizer_.probeRecord(text, driver_->column, probe_);
+        record = probe_.record;
+        split_ = false;
+        if (!timer) return evaluate(root_);
+        timer->lap(Stage::Tokenize);
+        bool match = evaluate(root_);
+        timer->lap(Stage::Filter);
+        return match;
+    }
+
+    // Fields of the last record, split on demand
+    const CsvFields& fields() {
+        if (!split_) {
+            tokenizer_.splitLine(probe_.record, fields_);
+            split_ = true;
+        }
+        return fields_;
+    }
+
+private:
+    bool evaluate(const QueryNode& node) {
+        if (node.kind == QueryNode::Kind::And) {
+            for (const auto& child : node.children) {
+                if (!evaluate(*child)) return false;
+            }
+            return true;
+        }
+        if (node.kind == QueryNode::Kind::Or) {
+            for (const auto& child : node.children) {
+                if (evaluate(*child)) return true;
+            }
+            return false;
+        }
+        std::string_view cell;
+        if (node.column == driver_->column && probe_.hasField && unquotedView(trim_ ? trimSpaces(probe_.field) : probe_.field, cell)) {
+            return evaluateLeaf(node, cell);
+        }
+        const CsvFields& row = fields();
+        if (node.column >= row.size()) return false;
+        return evaluateLeaf(node, trim_ ? trimSpaces(row[node.column]) : row[node.column]);
+    }
+
+    const QueryNode& root_;
+    const QueryNode* driver_;
+    CsvTokenizer tokenizer_;
+    RecordProbe probe_;
+    CsvFields fields_;
+    bool trim_;
+    bool split_ = false;
+};
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <initializer_list>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "CsvIndex.h"
+
+// Results of repeated lookups. An entry is the printed rows of one request, keyed on everything that shapes
+// them (dataset, column, value, mode, format, ...) and stamped with a fingerprint of the dataset's files: the
+// path, size, mtime and inode of every one. A lookup whose fingerprint no longer matches is a miss, so an
+// append, a rewrite or a new file invalidates the entries of its dataset. Entries live in a memory LRU bounded
+// by a byte budget and, when a directory is given, in one file each there, so separate processes (the
+// standalone binaries) and restarts share them; the directory is trimmed to the same budget, oldest first.
+//   CSV_RESULT_CACHE_MB   budget, 64 MB by default
+//   CSV_RESULT_CACHE_DIR  directory of the on-disk entries, none by default
+
+// Hash of the path, size, mtime and inode of every file; 0 when one of them cannot be read
+inline uint64_t fingerprintFiles(const std::vector<std::string>& paths) {
+    std::string stamps;
+    for (const std::string& path : paths) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) return 0;
+        stamps.append(path).append(1, '\0');
+        uint64_t fields[4] = {uint64_t(st.st_size), uint64_t(st.st_mtim.tv_sec), uint64_t(st.st_mtim.tv_nsec), uint64_t(st.st_ino)};
+        stamps.append(reinterpret_cast<const char*>(fields), sizeof(fields));
+    }
+    return hashValue(stamps) | 1;
+}
+
+// Join the parts of a key so that no two different lists of parts give the same key
+inline std::string resultKey(std::initializer_list<std::string_view> parts) {
+    std::string key;
+    for (std::string_view part : parts) key.append(std::to_string(part.size())).append(1, ':').append(part);
+    return key;
+}
+
+struct CachedResult {
+    std::string rows;
+    bool matched = false; // at least one row matched, rows may still hold a CSV header line only
+};
+
+struct ResultCacheCounters {
+    uint64_t hits = 0;
+    uint64_t diskHits = 0; // hits that were read back from the directory
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t entries = 0;
+    uint64_t bytes = 0;
+};
+
+struct ResultFileHeader {
+    char magic[8];
+    uint64_t fingerprint;
+    uint64_t keySize;
+    uint64_t rowsSize;
+    uint64_t matched;
+};
+
+constexpr char kResultMagic[8] = {'C', 'S', 'V', 'R', 'E', 'S', '1', '\0'};
+
+class ResultCache {
+public:
+    // Budget and directory from the environment, unless a directory is given
+    explicit ResultCache(std::string directory = std::string()) : directory_(std::move(directory)) {
+        const char* megabytes = std::getenv("CSV_RESULT_CACHE_MB");
+        const char* dir = std::getenv("CSV_RESULT_CACHE_DIR");
+        budget_ = size_t(megabytes && *megabytes ? std::strtoull(megabytes, nullptr, 10) : 64) << 20;
+        if (directory_.empty() && dir) directory_ = dir;
+        if (!directory_.empty()) mkdir(directory_.c_str(), 0777);
+    }
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    bool persistent() const { return !directory_.empty(); }
+
+    bool get(const std::string& key, uint64_t fingerprint, CachedResult& result) {
+        std::lock_guard<std::mutex> guard(lock_);
+        auto found = entries_.find(key);
+        if (found != entries_.end() && found->second->fingerprint == fingerprint && fingerprint != 0) {
+            lru_.splice(lru_.begin(), lru_, found->second);
+            result = found->second->result;
+            ++counters_.hits;
+            return true;
+        }
+        if (fingerprint != 0 && readFile(key, fingerprint, result)) {
+            insert(key, fingerprint, result);
+            ++counters_.hits;
+            ++counters_.diskHits;
+            return true;
+        }
+        ++counters_.misses;
+        return false;
+    }
+
+    void put(const std::string& key, uint64_t fingerprint, const CachedResult& result) {
+        if (fingerprint == 0 || entrySize(key, result) > budget_) return;
+        std::lock_guard<std::mutex> guard(lock_);
+        insert(key, fingerprint, result);
+        writeFile(key, fingerprint, result);
+    }
+
+    ResultCacheCounters counters() const {
+        std::lock_guard<std::mutex> guard(lock_);
+        ResultCacheCounters counters = counters_;
+        counters.entries = entries_.size();
+        counters.bytes = bytes_;
+        return counters;
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        uint64_t fingerprint;
+        CachedResult result;
+    };
+
+    static size_t entrySize(const std::string& key, const CachedResult& result) { return key.size() + result.rows.size() + sizeof(Entry); }
+
+    void insert(const std::string& key, uint64_t fingerprint, const CachedResult& result) {
+        auto found = entries_.find(key);
+        if (found != entries_.end()) {
+            bytes_ -= entrySize(key, found->second->result);
+            lru_.erase(found->second);
+            entries_.erase(found);
+        }
+        lru_.push_front(Entry{key, fingerprint, result});
+        entries_[key] = lru_.begin();
+        bytes_ += entrySize(key, result);
+        while (bytes_ > budget_ && !lru_.empty()) {
+            bytes_ -= entrySize(lru_.back().key, lru_.back().result);
+            entries_.erase(lru_.back().key);
+            lru_.pop_back();
+            ++counters_.evictions;
+        }
+    }
+
+    std::string pathFor(const std::string& key) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.res", (unsigned long long)hashValue(key));
+        return directory_ + "/" + name;
+    }
+
+    bool readFile(const std::string& key, uint64_t fingerprint, CachedResult& result) const {
+        if (directory_.empty()) return false;
+        std::string path = pathFor(key);
+        MappedFile file;
+        if (!file.open(path)) return false;
+        std::string_view data = file.view();
+        ResultFileHeader header;
+        if (data.size() < sizeof(header)) return false;
+        std::memcpy(&header, data.data(), sizeof(header));
+        if (std::memcmp(header.magic, kResultMagic, sizeof(kResultMagic)) != 0 || header.fingerprint != fingerprint ||
+            data.size() != sizeof(header) + header.keySize + header.rowsSize || data.substr(sizeof(header), header.keySize) != key) {
+            return false;
+        }
+        result.rows = std::string(data.substr(sizeof(header) + header.keySize));
+        result.matched = header.matched != 0;
+        // a read counts as a use for the trimming order
+        utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+        return true;
+    }
+
+    // Written under a temporary name first like the sidecar files, then the directory is trimmed to the budget
+    void writeFile(const std::string& key, uint64_t fingerprint, const CachedResult& result) const {
+        if (directory_.empty()) return;
+        ResultFileHeader header{};
+        std::memcpy(header.magic, kResultMagic, sizeof(header.magic));
+        header.fingerprint = fingerprint;
+        header.keySize = key.size();
+        header.rowsSize = result.rows.size();
+        header.matched = result.matched ? 1 : 0;
+        bool written = replaceFile(pathFor(key), [&](FILE* out) {
+            return std::fwrite(&header, sizeof(header), 1, out) == 1 && std::fwrite(key.data(), 1, key.size(), out) == key.size() &&
+                   std::fwrite(result.rows.data(), 1, result.rows.size(), out) == result.rows.size();
+        });
+        if (written) trimDirectory();
+    }
+
+    void trimDirectory() const {
+        struct Stored {
+            std::filesystem::file_time_type time;
+            uintmax_t size;
+            std::filesystem::path path;
+        };
+        std::vector<Stored> stored;
+        uintmax_t total = 0;
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(directory_, ec)) {
+            if (entry.path().extension() != ".res") continue;
+            stored.push_back({entry.last_write_time(ec), entry.file_size(ec), entry.path()});
+            total += stored.back().size;
+        }
+        if (total <= budget_) return;
+        std::sort(stored.begin(), stored.end(), [](const Stored& a, const Stored& b) { return a.time < b.time; });
+        for (const Stored& file : stored) {
+            if (total <= budget_) break;
+            std::filesystem::remove(file.path, ec);
+            total -= file.size;
+        }
+    }
+
+    size_t budget_ = 0;
+    std::string directory_;
+    mutable std::mutex lock_;
+    std::list<Entry> lru_; // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> entries_;
+    size_t bytes_ = 0;
+    ResultCacheCounters counters_;
+};
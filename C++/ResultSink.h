@@ -0,0 +1,254 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "StageStats.h"
+
+// Result output shared by the search binaries. Worker threads format matching rows into their own
+// ResultBuffer and hand whole batches to a lock-free multi-producer single-consumer queue; one writer thread
+// drains it to stdout, so the scan threads never wait on each other or on the terminal. Rows can be printed
+// as the original free text, as newline-delimited JSON objects keyed by header or as CSV.
+
+enum class OutputFormat { Text, Ndjson, Csv };
+
+inline bool parseOutputFormat(std::string_view name, OutputFormat& format) {
+    if (name == "text") format = OutputFormat::Text;
+    else if (name == "ndjson" || name == "json") format = OutputFormat::Ndjson;
+    else if (name == "csv") format = OutputFormat::Csv;
+    else return false;
+    return true;
+}
+
+inline const char* outputFormatName(OutputFormat format) {
+    switch (format) {
+        case OutputFormat::Ndjson: return "ndjson";
+        case OutputFormat::Csv: return "csv";
+        default: return "text";
+    }
+}
+
+inline void appendJsonString(std::string& out, std::string_view value) {
+    static const char hex[] = "0123456789abcdef";
+    out += '"';
+    for (char c : value) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (uint8_t(c) < 0x20) {
+                    out += "\\u00";
+                    out += hex[uint8_t(c) >> 4];
+                    out += hex[uint8_t(c) & 15];
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+// Quote a CSV value when it holds a delimiter, quote or line break, doubling embedded quotes
+inline void appendCsvField(std::string& out, std::string_view value) {
+    if (value.find_first_of(",\"\r\n") == std::string_view::npos) {
+        out.append(value);
+        return;
+    }
+    out += '"';
+    for (char c : value) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    out += '"';
+}
+
+inline std::string csvHeaderLine(const std::vector<std::string>& headers) {
+    std::string line;
+    for (size_t i = 0; i < headers.size(); ++i) {
+        if (i > 0) line += ',';
+        appendCsvField(line, headers[i]);
+    }
+    return line + '\n';
+}
+
+// Append one row as a JSON object or CSV line; cell(i) returns the value of column i for i < width
+template <class CellFn>
+void appendRow(std::string& out, OutputFormat format, const std::vector<std::string>& headers, size_t width, CellFn cell) {
+    width = std::min(width, headers.size());
+    if (format == OutputFormat::Csv) {
+        for (size_t i = 0; i < width; ++i) {
+            if (i > 0) out += ',';
+            appendCsvField(out, cell(i));
+        }
+        out += '\n';
+        return;
+    }
+    out += '{';
+    for (size_t i = 0; i < width; ++i) {
+        if (i > 0) out += ',';
+        appendJsonString(out, headers[i]);
+        out += ':';
+        appendJsonString(out, cell(i));
+    }
+    out += "}\n";
+}
+
+// A run of formatted rows from one byte range; source and offset of its first row allow ordered output
+struct ResultBatch {
+    uint64_t source = 0;
+    uint64_t offset = 0;
+    std::string text;
+    std::atomic<ResultBatch*> next{nullptr};
+};
+
+// Intrusive MPSC queue (Vyukov): producers swap themselves in as the head with one atomic exchange, the single
+// consumer follows the next pointers from the tail. A stub node keeps the queue non-empty.
+class ResultQueue {
+public:
+    ResultQueue() : head_(&stub_), tail_(&stub_) {}
+
+    void push(ResultBatch* batch) {
+        batch->next.store(nullptr, std::memory_order_relaxed);
+        ResultBatch* previous = head_.exchange(batch, std::memory_order_acq_rel);
+        previous->next.store(batch, std::memory_order_release);
+    }
+
+    // Consumer side only. Returns nullptr when empty, or when a producer is half way through a push.
+    ResultBatch* pop() {
+        ResultBatch* tail = tail_;
+        ResultBatch* next = tail->next.load(std::memory_order_acquire);
+        if (tail == &stub_) {
+            if (!next) return nullptr;
+            tail_ = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next) {
+            tail_ = next;
+            return tail;
+        }
+        if (tail != head_.load(std::memory_order_acquire)) return nullptr;
+        push(&stub_);
+        next = tail->next.load(std::memory_order_acquire);
+        if (next) {
+            tail_ = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+private:
+    std::atomic<ResultBatch*> head_;
+    ResultBatch* tail_;
+    ResultBatch stub_;
+};
+
+class ResultSink {
+public:
+    // ordered keeps every batch until finish() and prints them sorted by (source, offset), i.e. in file order.
+    // With copy everything written is appended to it as well; the writer thread owns it until finish().
+    explicit ResultSink(bool ordered = false, FILE* out = stdout, std::string* copy = nullptr)
+        : ordered_(ordered), out_(out), copy_(copy), writer_([this] { drain(); }) {}
+
+    ~ResultSink() { finish(); }
+
+    void push(uint64_t source, uint64_t offset, std::string text) {
+        ResultBatch* batch = new ResultBatch();
+        batch->source = source;
+        batch->offset = offset;
+        batch->text = std::move(text);
+        queue_.push(batch);
+    }
+
+    // Write out everything pushed so far and stop the writer; no pushes may follow
+    void finish() {
+        if (!writer_.joinable()) return;
+        done_.store(true, std::memory_order_release);
+        writer_.join();
+        if (ordered_) {
+            StageTimer timer;
+            std::stable_sort(held_.begin(), held_.end(), [](const ResultBatch* a, const ResultBatch* b) {
+                return a->source != b->source ? a->source < b->source : a->offset < b->offset;
+            });
+            for (ResultBatch* batch : held_) {
+                write(batch->text);
+                delete batch;
+            }
+            held_.clear();
+            timer.lap(Stage::Emit);
+        }
+        std::fflush(out_);
+    }
+
+private:
+    void write(const std::string& text) {
+        std::fwrite(text.data(), 1, text.size(), out_);
+        if (copy_) copy_->append(text);
+    }
+
+    void drain() {
+        StageTimer timer;
+        while (true) {
+            bool finishing = done_.load(std::memory_order_acquire);
+            ResultBatch* batch = queue_.pop();
+            if (batch) {
+                if (ordered_) {
+                    held_.push_back(batch);
+                } else {
+                    write(batch->text);
+                    delete batch;
+                }
+                timer.lap(Stage::Emit);
+                continue;
+            }
+            // done_ was set before this empty pop, so every producer had already returned
+            if (finishing) return;
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+            timer.skip();
+        }
+    }
+
+    bool ordered_;
+    FILE* out_;
+    std::string* const copy_;
+    ResultQueue queue_;
+    std::vector<ResultBatch*> held_;
+    std::atomic<bool> done_{false};
+    std::thread writer_;
+};
+
+// Thread-local staging for one byte range: rows are formatted into a private string and reach the sink as one
+// batch when the range is done or the buffer grows large
+class ResultBuffer {
+public:
+    ResultBuffer(ResultSink& sink, uint64_t source = 0) : sink_(sink), source_(source) {}
+    ~ResultBuffer() { flush(); }
+
+    // Start a row of the record at byte offset and return the string to format it into
+    std::string& beginRow(uint64_t offset) {
+        if (text_.size() >= (64 << 10)) flush();
+        if (text_.empty()) offset_ = offset;
+        return text_;
+    }
+
+    void flush() {
+        if (text_.empty()) return;
+        sink_.push(source_, offset_, std::move(text_));
+        text_.clear();
+    }
+
+private:
+    ResultSink& sink_;
+    uint64_t source_;
+    uint64_t offset_ = 0;
+    std::string text_;
+};
@@ -0,0 +1,415 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <thread>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "ResultSink.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// Runs every search binary against synthetic copies of the three datasets and writes a JSON report. Each case
+// is timed from fork to exit, so all binaries are measured the same way whatever they print themselves, and
+// the peak RSS comes from the child's rusage. Parallel cases are repeated for every thread count through
+// OMP_NUM_THREADS to give the scaling curve.
+//
+//     ./SearchBenchmark --bin=. --dir=/tmp/csvbench --data3-rows=1000000 --reps=5 --report=bench.json
+
+struct BenchConfig {
+    string binDir = ".";
+    string workDir = "bench";
+    string reportPath;
+    string label;
+    string only; // run only cases whose name contains this
+    size_t data1Rows = 20000;
+    size_t data2Files = 48;
+    size_t data2Rows = 20000;
+    size_t data3Rows = 1000000;
+    int warmup = 1;
+    int repetitions = 5;
+    vector<int> threads;
+};
+
+// One search: binary and arguments, with the rows and bytes of the dataset it scans
+struct BenchCase {
+    string name;
+    string binary;
+    vector<string> args;
+    bool parallel = false;
+    uint64_t rows = 0;
+    uint64_t bytes = 0;
+};
+
+struct BenchResult {
+    int threads = 1;
+    vector<double> seconds;
+    double median = 0;
+    double mean = 0;
+    double min = 0;
+    double stddev = 0;
+    long peakRssKb = 0;
+    bool failed = false;
+};
+
+const string data1File = "Data Sets/Data1 - World Bank Population Data/API_SP.POP.TOTL_DS2_en_csv_v2_3401680.csv";
+const string data2Dir = "Data Sets/Data2 - AirNow 2020 California Complex Fire";
+const string data3File = "Data Sets/Data3 - NYC Data Organization/Parking_Violations_Issued_-_Fiscal_Year_2022.csv";
+
+// Buffered writer for the generated files
+class CsvWriter {
+public:
+    explicit CsvWriter(const fs::path& path) : file_(fopen(path.c_str(), "wb")) {}
+    ~CsvWriter() {
+        flush();
+        if (file_) fclose(file_);
+    }
+    bool ok() const { return file_ != nullptr; }
+    string& line() {
+        if (buffer_.size() >= (1 << 20)) flush();
+        return buffer_;
+    }
+
+private:
+    void flush() {
+        if (file_) fwrite(buffer_.data(), 1, buffer_.size(), file_);
+        buffer_.clear();
+    }
+
+    FILE* file_;
+    string buffer_;
+};
+
+// World Bank layout: four preamble lines, quoted cells, a trailing delimiter on every line.
+// "Benchland" sits three quarters of the way down.
+bool generateData1(const fs::path& root, size_t rows, mt19937_64& random) {
+    fs::path path = root / data1File;
+    fs::create_directories(path.parent_path());
+    CsvWriter out(path);
+    if (!out.ok()) return false;
+    out.line() += "\"Data Source\",\"World Development Indicators\",\n\n\"Last Updated Date\",\"2021-09-15\",\n\n";
+    string& header = out.line();
+    header += "\"Country Name\",\"Country Code\",\"Indicator Name\",\"Indicator Code\",";
+    for (int year = 1960; year <= 2020; ++year) header += "\"" + to_string(year) + "\",";
+    header += '\n';
+    uniform_int_distribution<long> population(1000, 1000000000);
+    for (size_t i = 0; i < rows; ++i) {
+        string name = i == rows * 3 / 4 ? "Benchland" : i % 97 == 0 ? "Korea, Rep. " + to_string(i) : "Country " + to_string(i);
+        string& line = out.line();
+        line += "\"" + name + "\",\"C" + to_string(i % 1000) + "\",\"Population, total\",\"SP.POP.TOTL\",";
+        for (int year = 1960; year <= 2020; ++year) line += "\"" + to_string(population(random)) + "\",";
+        line += '\n';
+    }
+    return true;
+}
+
+// AirNow layout: headerless quoted rows spread over one directory per day with 24 hourly files.
+// "Jacobs" appears once in the last file.
+bool generateData2(const fs::path& root, size_t files, size_t rowsPerFile, mt19937_64& random) {
+    uniform_real_distribution<double> lat(32, 42), lon(-124, -114), ozone(0, 80), pm(0, 300);
+    uniform_int_distribution<int> site(0, 300), digit(0, 9);
+    char cell[64];
+    for (size_t f = 0; f < files; ++f) {
+        size_t day = 10 + f / 24;
+        size_t hour = f % 24;
+        snprintf(cell, sizeof(cell), "202008%02zu", day);
+        fs::path dir = root / data2Dir / cell;
+        fs::create_directories(dir);
+        snprintf(cell, sizeof(cell), "202008%02zu-%02zu.csv", day, hour);
+        CsvWriter out(dir / cell);
+        if (!out.ok()) return false;
+        for (size_t i = 0; i < rowsPerFile; ++i) {
+            string location = f == files - 1 && i == rowsPerFile / 2 ? "Jacobs" : "Site" + to_string(site(random));
+            char line[256];
+            snprintf(line, sizeof(line), "\"%.4f\",\"%.4f\",\"2020-08-%02zuT%02zu:00\",\"%.1f\",\"%.1f\",\"-999\",\"-999\",\"-999\",\"-999\",\"%s\",\"%s Area\",\"%d\",\"%d\"\n",
+                     lat(random), lon(random), day, hour, ozone(random), pm(random), location.c_str(), location.c_str(), digit(random), digit(random));
+            out.line() += line;
+        }
+    }
+    return true;
+}
+
+// NYC parking layout: one header line, unquoted cells except the street names with commas.
+// Plate "KGL8099" sits three quarters of the way down, every seventh row is on "BROADWAY, W".
+bool generateData3(const fs::path& root, size_t rows, mt19937_64& random) {
+    fs::path path = root / data3File;
+    fs::create_directories(path.parent_path());
+    CsvWriter out(path);
+    if (!out.ok()) return false;
+    out.line() += "Summons Number,Plate ID,Registration State,Plate Type,Issue Date,Violation Code,Vehicle Body Type,Vehicle Make,Street Name,Violation County\n";
+    uniform_int_distribution<int> plate(0, 999999), code(1, 99);
+    const char* makes[] = {"TOYOT", "HONDA", "FORD", "NISSA", "CHEVR"};
+    for (size_t i = 0; i < rows; ++i) {
+        char plateId[16];
+        if (i == rows * 3 / 4) snprintf(plateId, sizeof(plateId), "KGL8099");
+        else snprintf(plateId, sizeof(plateId), "P%06d", plate(random));
+        char line[256];
+        snprintf(line, sizeof(line), "%zu,%s,NY,PAS,%02zu/%02zu/2022,%d,SUBN,%s,%s,NY\n", 1000000 + i, plateId, i % 12 + 1, i % 28 + 1,
+                 code(random), makes[i % 5], i % 7 == 0 ? "\"BROADWAY, W\"" : "5TH AVE");
+        out.line() += line;
+    }
+    return true;
+}
+
+uint64_t pathBytes(const fs::path& path) {
+    std::error_code ec;
+    if (fs::is_regular_file(path, ec)) return fs::file_size(path, ec);
+    uint64_t bytes = 0;
+    for (const auto& entry : fs::recursive_directory_iterator(path, ec)) {
+        if (entry.is_regular_file(ec)) bytes += entry.file_size(ec);
+    }
+    return bytes;
+}
+
+// The data is only generated again when its parameters changed, the seed is fixed
+bool prepareData(const BenchConfig& config) {
+    fs::path root = config.workDir;
+    string params = to_string(config.data1Rows) + " " + to_string(config.data2Files) + " " + to_string(config.data2Rows) + " " +
+                    to_string(config.data3Rows) + "\n";
+    fs::path stamp = root / "Data Sets" / ".params";
+    ifstream previous(stamp);
+    stringstream existing;
+    existing << previous.rdbuf();
+    if (existing.str() == params) return true;
+
+    cerr << "Generating synthetic data in " << root << endl;
+    std::error_code ec;
+    fs::remove_all(root / "Data Sets", ec);
+    fs::create_directories(root / "C++");
+    mt19937_64 random(20200810);
+    if (!generateData1(root, config.data1Rows, random) || !generateData2(root, config.data2Files, config.data2Rows, random) ||
+        !generateData3(root, config.data3Rows, random)) {
+        return false;
+    }
+    ofstream(stamp) << params;
+    return true;
+}
+
+vector<BenchCase> benchCases(const BenchConfig& config) {
+    fs::path root = config.workDir;
+    uint64_t data1Bytes = pathBytes(root / data1File);
+    uint64_t data2Bytes = pathBytes(root / data2Dir);
+    uint64_t data3Bytes = pathBytes(root / data3File);
+    uint64_t data2Rows = uint64_t(config.data2Files) * config.data2Rows;
+    vector<BenchCase> cases = {
+        {"data1-serial", "Data1Serial", {"Country Name", "Benchland"}, false, config.data1Rows, data1Bytes},
+        {"data1-parallel", "Data1Parallel", {"Country Name", "Benchland"}, true, config.data1Rows, data1Bytes},
+        {"data2-serial", "Data2Serial", {"location1", "Jacobs"}, false, data2Rows, data2Bytes},
+        {"data2-parallel-all", "Data2Parallel", {"location1", "Jacobs", "all"}, true, data2Rows, data2Bytes},
+        {"data2-parallel-where", "Data2Parallel", {"--where", "measurement_PM2.5>290"}, true, data2Rows, data2Bytes},
+        {"data3-serial", "Data3Serial", {"Plate ID", "KGL8099"}, false, config.data3Rows, data3Bytes},
+        {"data3-parallel-first", "Data3Parallel", {"Plate ID", "KGL8099"}, true, config.data3Rows, data3Bytes},
+        {"data3-parallel-nomatch", "Data3Parallel", {"Plate ID", "NOMATCH", "all"}, true, config.data3Rows, data3Bytes},
+        {"data3-parallel-output", "Data3Parallel", {"Street Name", "BROADWAY, W", "all", "--format=csv"}, true, config.data3Rows, data3Bytes},
+        {"data3-parallel-query", "Data3Parallel", {"--query", "Violation Code>=90 AND Vehicle Make=HONDA"}, true, config.data3Rows, data3Bytes},
+        {"data3-parallel-groupby", "Data3Parallel", {"--group-by", "Violation Code", "--agg=count"}, true, config.data3Rows, data3Bytes},
+    };
+    vector<BenchCase> selected;
+    for (BenchCase& c : cases) {
+        if (c.name.find(config.only) != string::npos) selected.push_back(c);
+    }
+    return selected;
+}
+
+// Run the binary once from <workDir>/C++ so its "../Data Sets" paths resolve, output discarded. Returns the wall
+// time in seconds, or a negative value when it could not run or exited with an error.
+double runOnce(const BenchConfig& config, const BenchCase& benchCase, int threads, long& peakRssKb) {
+    string binary = fs::absolute(fs::path(config.binDir) / benchCase.binary).string();
+    string cwd = (fs::path(config.workDir) / "C++").string();
+    vector<char*> argv;
+    argv.push_back(const_cast<char*>(binary.c_str()));
+    for (const string& arg : benchCase.args) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+    string threadCount = to_string(threads);
+
+    auto start = chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        int devNull = open("/dev/null", O_WRONLY);
+        if (devNull < 0 || chdir(cwd.c_str()) != 0) _exit(127);
+        dup2(devNull, STDOUT_FILENO);
+        dup2(devNull, STDERR_FILENO);
+        if (benchCase.parallel) setenv("OMP_NUM_THREADS", threadCount.c_str(), 1);
+        execv(binary.c_str(), argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage usage = {};
+    if (wait4(pid, &status, 0, &usage) < 0) return -1;
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    peakRssKb = usage.ru_maxrss;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? seconds : -1;
+}
+
+BenchResult runCase(const BenchConfig& config, const BenchCase& benchCase, int threads) {
+    BenchResult result;
+    result.threads = threads;
+    long rss = 0;
+    for (int i = 0; i < config.warmup; ++i) {
+        if (runOnce(config, benchCase, threads, rss) < 0) {
+            result.failed = true;
+            return result;
+        }
+    }
+    for (int i = 0; i < config.repetitions; ++i) {
+        double seconds = runOnce(config, benchCase, threads, rss);
+        if (seconds < 0) {
+            result.failed = true;
+            return result;
+        }
+        result.seconds.push_back(seconds);
+        result.peakRssKb = max(result.peakRssKb, rss);
+    }
+    vector<double> sorted = result.seconds;
+    sort(sorted.begin(), sorted.end());
+    size_t n = sorted.size();
+    result.min = sorted.front();
+    result.median = n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    for (double s : sorted) result.mean += s / n;
+    for (double s : sorted) result.stddev += (s - result.mean) * (s - result.mean) / n;
+    result.stddev = sqrt(result.stddev);
+    return result;
+}
+
+// 1, 2, 4, ... up to the core count, which is always included
+vector<int> defaultThreadCounts() {
+    int cores = max(1u, thread::hardware_concurrency());
+    vector<int> counts;
+    for (int t = 1; t < cores; t *= 2) counts.push_back(t);
+    counts.push_back(cores);
+    return counts;
+}
+
+bool parseThreadCounts(const string& list, vector<int>& counts) {
+    counts.clear();
+    stringstream stream(list);
+    string item;
+    while (getline(stream, item, ',')) {
+        int count = atoi(item.c_str());
+        if (count < 1) return false;
+        counts.push_back(count);
+    }
+    return !counts.empty();
+}
+
+string jsonNumber(double value) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.6g", value);
+    return buffer;
+}
+
+int main(int argc, char *argv[]) {
+    BenchConfig config;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        auto value = [&](const char* name, string& out) {
+            size_t length = strlen(name);
+            if (arg.compare(0, length, name) != 0) return false;
+            out = arg.substr(length);
+            return true;
+        };
+        string v;
+        if (value("--bin=", v)) config.binDir = v;
+        else if (value("--dir=", v)) config.workDir = v;
+        else if (value("--report=", v)) config.reportPath = v;
+        else if (value("--label=", v)) config.label = v;
+        else if (value("--only=", v)) config.only = v;
+        else if (value("--data1-rows=", v)) config.data1Rows = stoul(v);
+        else if (value("--data2-files=", v)) config.data2Files = max(1ul, stoul(v));
+        else if (value("--data2-rows=", v)) config.data2Rows = stoul(v);
+        else if (value("--data3-rows=", v)) config.data3Rows = stoul(v);
+        else if (value("--warmup=", v)) config.warmup = max(0, stoi(v));
+        else if (value("--reps=", v)) config.repetitions = max(1, stoi(v));
+        else if (value("--threads=", v)) {
+            if (!parseThreadCounts(v, config.threads)) {
+                cerr << "Error: Bad thread list " << v << endl;
+                return 1;
+            }
+        } else {
+            cerr << "Error: Unknown option " << arg << endl;
+            return 1;
+        }
+    }
+    if (config.threads.empty()) config.threads = defaultThreadCounts();
+
+    if (!prepareData(config)) {
+        cerr << "Error: Could not write the synthetic data to " << config.workDir << endl;
+        return 1;
+    }
+
+    string report = "{\"label\":";
+    appendJsonString(report, config.label);
+    report += ",\"cores\":" + to_string(thread::hardware_concurrency()) + ",\"warmup\":" + to_string(config.warmup) +
+              ",\"repetitions\":" + to_string(config.repetitions) + ",\"cases\":[";
+    bool firstCase = true;
+    for (const BenchCase& benchCase : benchCases(config)) {
+        vector<int> counts = benchCase.parallel ? config.threads : vector<int>{1};
+        if (!firstCase) report += ',';
+        firstCase = false;
+        report += "{\"name\":";
+        appendJsonString(report, benchCase.name);
+        report += ",\"binary\":";
+        appendJsonString(report, benchCase.binary);
+        report += ",\"args\":[";
+        for (size_t a = 0; a < benchCase.args.size(); ++a) {
+            if (a > 0) report += ',';
+            appendJsonString(report, benchCase.args[a]);
+        }
+        report += "],\"rows\":" + to_string(benchCase.rows) + ",\"bytes\":" + to_string(benchCase.bytes) + ",\"runs\":[";
+
+        double baseline = 0;
+        for (size_t t = 0; t < counts.size(); ++t) {
+            BenchResult result = runCase(config, benchCase, counts[t]);
+            if (t > 0) report += ',';
+            report += "{\"threads\":" + to_string(result.threads);
+            if (result.failed) {
+                cerr << benchCase.name << " threads=" << counts[t] << ": failed" << endl;
+                report += ",\"failed\":true}";
+                continue;
+            }
+            if (t == 0) baseline = result.median;
+            double rowsPerSecond = benchCase.rows / result.median;
+            double bytesPerSecond = benchCase.bytes / result.median;
+            double speedup = baseline / result.median;
+            report += ",\"median_s\":" + jsonNumber(result.median) + ",\"mean_s\":" + jsonNumber(result.mean) +
+                      ",\"min_s\":" + jsonNumber(result.min) + ",\"stddev_s\":" + jsonNumber(result.stddev) +
+                      ",\"rows_per_s\":" + jsonNumber(rowsPerSecond) + ",\"bytes_per_s\":" + jsonNumber(bytesPerSecond) +
+                      ",\"peak_rss_kb\":" + to_string(result.peakRssKb) + ",\"speedup\":" + jsonNumber(speedup) + ",\"seconds\":[";
+            for (size_t r = 0; r < result.seconds.size(); ++r) {
+                if (r > 0) report += ',';
+                report += jsonNumber(result.seconds[r]);
+            }
+            report += "]}";
+            cerr << benchCase.name << " threads=" << result.threads << ": " << result.median << " s, "
+                 << rowsPerSecond / 1e6 << " M rows/s, " << bytesPerSecond / (1 << 20) << " MB/s, " << result.peakRssKb / 1024
+                 << " MB peak RSS, x" << speedup << endl;
+        }
+        report += "]}";
+    }
+    report += "]}\n";
+
+    if (config.reportPath.empty()) {
+        cout << report;
+    } else {
+        ofstream out(config.reportPath);
+        out << report;
+        if (!out) {
+            cerr << "Error: Could not write " << config.reportPath << endl;
+            return 1;
+        }
+    }
+    return 0;
+}
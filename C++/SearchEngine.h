@@ -0,0 +1,1171 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <omp.h>
+#include "Arena.h"
+#include "StageStats.h"
+#include "MappedFile.h"
+#include "CsvTokenizer.h"
+#include "SearchMode.h"
+#include "PatternMatch.h"
+#include "CsvIndex.h"
+#include "BloomFilter.h"
+#include "ColumnarCache.h"
+#include "BlockReader.h"
+#include "CompressedReader.h"
+#include "ResultSink.h"
+#include "TypedColumns.h"
+#include "QueryEngine.h"
+#include "GroupBy.h"
+#include "ColumnTable.h"
+#include "WorkStealing.h"
+#include "CpuBudget.h"
+#include "TailFollow.h"
+#include "ResultCache.h"
+#include "Dataset.h"
+
+// The search engine behind every Data* binary and CsvSearch. A DatasetDescriptor says where the files are and
+// how they are laid out, a SearchRequest what to look for, and the strategy how the files are walked:
+//   serial    one thread loads each file into a ColumnTable and filters the searched column afterwards
+//   parallel  files are cut into record-aligned byte ranges that a pool of threads scans with work stealing
+//   indexed   only the candidates of the sidecar indexes are checked, every file needs a fresh index
+// Serial and parallel use an index too where one is fresh, and otherwise the columnar cache written by
+// --convert for searches and range queries. Files whose Bloom filter rules out the looked up value are dropped
+// before anything else. gzip and zstd compressed files without a cache are always streamed
+// through the decompressor, whatever the strategy. With --state or --follow only what was appended to the files
+// since the last pass is scanned (TailFollow.h). With a result cache directory the rows of searches and queries
+// are kept there and printed again as long as the files are unchanged (ResultCache.h).
+
+enum class Strategy { Serial, Parallel, Indexed };
+
+inline bool parseStrategy(std::string_view name, Strategy& strategy) {
+    if (name == "serial") strategy = Strategy::Serial;
+    else if (name == "parallel") strategy = Strategy::Parallel;
+    else if (name == "indexed") strategy = Strategy::Indexed;
+    else return false;
+    return true;
+}
+
+enum class RequestKind { Search, Where, Query, GroupBy, BuildIndex, BuildBloom, Convert };
+
+struct SearchRequest {
+    RequestKind kind = RequestKind::Search;
+    std::string header; // searched header, group-by key or indexed header
+    std::string value;  // searched value, range predicates or query expression
+    MatchMode mode = MatchMode::First;
+    MatchKind match = MatchKind::Exact; // how a search compares the value with the cell
+    bool ignoreCase = false;
+    bool anyOf = false;                 // the value lists several terms separated by '|'
+    OutputFormat format = OutputFormat::Text;
+    Strategy strategy = Strategy::Parallel;
+    bool ordered = false;
+    bool stats = false;
+    bool streamed = false;
+    ReadOptions readOptions;
+    size_t threads = 0; // 0 keeps the dataset's default
+    std::string schema;
+    std::string aggregates;
+    std::string filter;
+    bool follow = false;   // keep scanning appends as they arrive
+    std::string statePath; // high-water offsets kept between runs
+    std::string cacheDir;  // result cache, CSV_RESULT_CACHE_DIR when empty
+    double falsePositiveRate = defaultBloomFalsePositiveRate; // of the Bloom filters --build-bloom writes
+};
+
+// Parse "<header> <value> [options]" with argv[0] the program. In place of header and value:
+//   --where <predicates>      numeric range query such as "lat:33..35,measurement_PM2.5>150"
+//   --query <expression>      AND/OR over several columns, e.g. "Plate ID=KGL8099 AND Issue Date^=03/"
+//   --group-by <header>       aggregate instead of printing rows, with --agg=count,sum:<h>,min:<h>,max:<h>,avg:<h>
+//                             and an optional --filter=<expression> in the query syntax
+//   --build-index <header>    write the sidecar index of that column next to every file
+//   --build-bloom <header>    write the Bloom filter of that column next to every file without a fresh one, with
+//                             --fp-rate=<rate> (0.01)
+//   --convert                 write the columnar cache next to every file
+// Options: first|first-per-file|all, --match=exact|prefix|contains with --ignore-case (ASCII) and --any-of
+// (the value is a '|' separated list of terms), --format=text|ndjson|csv, --ordered (rows in file order),
+// --strategy=serial|parallel|indexed, --threads=N, --schema=<header>:<int|float|text>,... for --where,
+// --io=uring|pread with --queue-depth=N and --block-kb=N to stream the files instead of mapping them,
+// --state=<file> to only scan what was appended since the run that wrote the file, --follow to keep scanning
+// appends as they arrive, --cache-dir=<dir> to keep and reuse the results, and --stats for heap allocations, per-stage times and the balance of the worker
+// threads on stderr.
+inline bool parseSearchArgs(int argc, char* argv[], const DatasetDescriptor& dataset, SearchRequest& request, std::string& error) {
+    std::string first = argv[1];
+    request.header = first;
+    if (first == "--where") request.kind = RequestKind::Where;
+    else if (first == "--query") request.kind = RequestKind::Query;
+    else if (first == "--group-by") request.kind = RequestKind::GroupBy;
+    else if (first == "--build-index") request.kind = RequestKind::BuildIndex;
+    else if (first == "--build-bloom") request.kind = RequestKind::BuildBloom;
+    else if (first == "--convert") request.kind = RequestKind::Convert;
+    // --convert is the only request without a value
+    int optionsAt = request.kind == RequestKind::Convert ? 2 : 3;
+    if (optionsAt == 3) request.value = argv[2];
+    if (request.kind == RequestKind::GroupBy || request.kind == RequestKind::BuildIndex || request.kind == RequestKind::BuildBloom) {
+        request.header = request.value;
+    }
+    // range queries and expressions print every match unless a mode is given
+    request.mode = request.kind == RequestKind::Search ? dataset.defaultMode : MatchMode::All;
+
+    for (int i = optionsAt; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--ordered") {
+            request.ordered = true;
+        } else if (arg == "--stats") {
+            request.stats = true;
+        } else if (arg == "--follow") {
+            request.follow = true;
+        } else if (arg.rfind("--state=", 0) == 0) {
+            request.statePath = arg.substr(8);
+        } else if (arg.rfind("--cache-dir=", 0) == 0) {
+            request.cacheDir = arg.substr(12);
+        } else if (arg.rfind("--fp-rate=", 0) == 0) {
+            request.falsePositiveRate = std::atof(arg.c_str() + 10);
+            if (!(request.falsePositiveRate > 0 && request.falsePositiveRate < 1)) {
+                error = "The false-positive rate must lie between 0 and 1";
+                return false;
+            }
+        } else if (arg.rfind("--match=", 0) == 0) {
+            if (!parseMatchKind(arg.substr(8), request.match)) {
+                error = "Unknown match kind " + arg.substr(8);
+                return false;
+            }
+        } else if (arg == "--ignore-case") {
+            request.ignoreCase = true;
+        } else if (arg == "--any-of") {
+            request.anyOf = true;
+        } else if (arg.rfind("--format=", 0) == 0) {
+            if (!parseOutputFormat(arg.substr(9), request.format)) {
+                error = "Unknown output format " + arg.substr(9);
+                return false;
+            }
+        } else if (arg.rfind("--strategy=", 0) == 0) {
+            if (!parseStrategy(arg.substr(11), request.strategy)) {
+                error = "Unknown strategy " + arg.substr(11);
+                return false;
+            }
+        } else if (arg.rfind("--threads=", 0) == 0) {
+            request.threads = size_t(std::max(1, std::atoi(arg.c_str() + 10)));
+        } else if (arg.rfind("--schema=", 0) == 0) {
+            request.schema = arg.substr(9);
+        } else if (arg.rfind("--agg=", 0) == 0) {
+            request.aggregates = arg.substr(6);
+        } else if (arg.rfind("--filter=", 0) == 0) {
+            request.filter = arg.substr(9);
+        } else if (arg.rfind("--io=", 0) == 0) {
+            if (!parseIoBackend(arg.substr(5), request.readOptions.backend)) {
+                error = "Unknown io backend " + arg.substr(5);
+                return false;
+            }
+            request.streamed = true;
+        } else if (arg.rfind("--queue-depth=", 0) == 0) {
+            request.readOptions.queueDepth = std::max(1, std::atoi(arg.c_str() + 14));
+        } else if (arg.rfind("--block-kb=", 0) == 0) {
+            request.readOptions.blockSize = size_t(std::max(64, std::atoi(arg.c_str() + 11))) << 10;
+        } else if (!parseMatchMode(arg, request.mode)) {
+            error = "Unknown match mode " + arg;
+            return false;
+        }
+    }
+    if (!request.follow && request.statePath.empty()) return true;
+    if (request.kind == RequestKind::BuildIndex || request.kind == RequestKind::BuildBloom || request.kind == RequestKind::Convert ||
+        request.strategy == Strategy::Indexed) {
+        error = "--follow and --state scan appends with the serial or parallel strategy only";
+        return false;
+    }
+    // the marks say what was scanned, not what it added up to
+    if (request.kind == RequestKind::GroupBy && !request.statePath.empty()) {
+        error = "--state does not keep aggregates, use --follow for running totals";
+        return false;
+    }
+    return true;
+}
+
+class SearchEngine {
+public:
+    SearchEngine(const DatasetDescriptor& dataset, const SearchRequest& request)
+        : dataset_(dataset), request_(request), summary_(request.format == OutputFormat::Text ? std::cout : std::cerr) {}
+
+    // Run the request and return the exit code of the program
+    int run() {
+        if (request_.stats) enableStageStats();
+        std::vector<std::string> paths = datasetFiles(dataset_);
+        if (paths.empty()) {
+            std::cerr << "Error: No csv files found at " << dataset_.path << std::endl;
+            return 1;
+        }
+        for (const std::string& path : paths) {
+            files_.push_back(std::make_unique<File>());
+            files_.back()->path = path;
+            files_.back()->compression = detectCompression(path);
+            std::error_code ec;
+            files_.back()->size = std::filesystem::file_size(path, ec);
+            if (ec) files_.back()->size = 0;
+        }
+        if (printCachedResult(paths)) return 0;
+        if (!readHeaders()) return 1;
+        numThreads_ = threadCount();
+
+        if (request_.kind == RequestKind::BuildIndex) return buildIndexes();
+        if (request_.kind == RequestKind::BuildBloom) return buildBloomFilters();
+        if (request_.kind == RequestKind::Convert) return convertFiles();
+        if (!prepare()) return 1;
+        // nothing can match a header that does not exist
+        if (request_.kind == RequestKind::Search && column_ >= headers_.size()) {
+            summary_ << noMatch() << std::endl;
+            printTime();
+            return 0;
+        }
+        if (request_.strategy == Strategy::Indexed && !requireIndexes()) return 1;
+
+        // the cached rows start with the CSV header, so the copy is handed over before anything is pushed
+        CachedResult fresh;
+        sink_ = std::make_unique<ResultSink>(request_.ordered, stdout, results_ ? &fresh.rows : nullptr);
+        if (request_.format == OutputFormat::Csv && request_.kind != RequestKind::GroupBy) sink_->push(0, 0, csvHeaderLine(headers_));
+        if (incremental()) return followFiles();
+        bool ok = request_.streamed && request_.kind != RequestKind::GroupBy && request_.strategy != Strategy::Indexed ? streamFiles()
+                                                                                                                       : runTasks(planTasks());
+        ok = scanCompressedFiles() && ok;
+        sink_->finish();
+        if (results_ && ok) {
+            fresh.matched = matchFound_.load();
+            results_->put(resultKey_, fingerprint_, fresh);
+        }
+        printSummary();
+        return ok ? 0 : 1;
+    }
+
+private:
+    void printSummary() {
+        if (request_.kind == RequestKind::GroupBy) {
+            printGroups();
+            summary_ << groups_[0].size() << " groups" << std::endl;
+        } else if (!matchFound_.load()) {
+            summary_ << noMatch() << std::endl;
+        }
+        if (request_.stats && bloomFiles_) {
+            std::cerr << prunedFiles_ << " of " << files_.size() << " files pruned by Bloom filters (" << 100.0 * double(prunedFiles_) / double(files_.size())
+                      << "%), " << bloomFiles_ << " had a fresh one" << std::endl;
+        }
+        if (request_.stats && cachedFiles_) {
+            std::cerr << cachedFiles_ << " files from the columnar cache, " << skippedBlocks_.load() << " blocks skipped by zone maps" << std::endl;
+        }
+        if (request_.stats) std::cerr << allocationReport() << std::endl << stageReport();
+        printTime();
+    }
+
+    // The groups of every worker are folded into the first table, which carries the running totals of --follow
+    void printGroups() {
+        for (size_t t = 1; t < groups_.size(); ++t) {
+            groups_[0].merge(groups_[t]);
+            groups_[t] = GroupTable(groupSpec_.valueColumns.size());
+        }
+        std::cout << formatGroups(groups_[0], groupSpec_, headers_, request_.format);
+        std::cout.flush();
+    }
+
+    bool incremental() const { return request_.follow || !request_.statePath.empty(); }
+
+    // Searches and queries answered before from files that are still the same are printed from the result
+    // cache without reading them. On a miss the cache stays open to keep the rows of this run.
+    bool printCachedResult(const std::vector<std::string>& paths) {
+        if (request_.kind == RequestKind::GroupBy || request_.kind == RequestKind::BuildIndex || request_.kind == RequestKind::BuildBloom ||
+            request_.kind == RequestKind::Convert || incremental()) {
+            return false;
+        }
+        results_ = std::make_unique<ResultCache>(request_.cacheDir);
+        if (!results_->persistent()) {
+            results_.reset();
+            return false;
+        }
+        std::string headers;
+        for (const std::string& header : dataset_.headers) headers.append(header).append(1, '\0');
+        resultKey_ = resultKey({dataset_.path, std::to_string(dataset_.skipRows), dataset_.headerRow ? "header" : "", headers,
+                                std::string(1, dataset_.delimiter), dataset_.trimValues ? "trim" : "", dataset_.schema,
+                                std::to_string(int(request_.kind)), request_.header, request_.value, std::to_string(int(request_.mode)),
+                                matchKindName(request_.match), request_.ignoreCase ? "ignore-case" : "", request_.anyOf ? "any-of" : "",
+                                std::to_string(int(request_.format)), request_.ordered ? "ordered" : "", request_.schema});
+        fingerprint_ = fingerprintFiles(paths);
+        CachedResult cached;
+        bool hit = results_->get(resultKey_, fingerprint_, cached);
+        if (request_.stats) std::cerr << "result cache: " << (hit ? "hit" : "miss") << std::endl;
+        if (!hit) return false;
+        std::fwrite(cached.rows.data(), 1, cached.rows.size(), stdout);
+        std::fflush(stdout);
+        if (!cached.matched) summary_ << noMatch() << std::endl;
+        printTime();
+        return true;
+    }
+
+    struct File {
+        std::string path;
+        uintmax_t size = 0;
+        Compression compression = Compression::None;
+        std::unique_ptr<MappedFile> mapping; // only for files that are split into several tasks
+        bool indexed = false;                // has a fresh index of the searched column
+        bool pruned = false;                 // its Bloom filter rules out the looked up value
+        std::unique_ptr<ColumnarCache> cache; // fresh columnar cache, for searches and range queries
+        std::atomic<bool> done{false};       // printed its row in first-per-file mode
+    };
+
+    // a whole file, or one record-aligned byte range of a large file (a range of blocks of a cached one)
+    struct Task {
+        size_t file = 0;
+        bool wholeFile = true;
+        size_t begin = 0;
+        size_t length = 0;
+    };
+
+    struct WorkerStats {
+        size_t tasks = 0;
+        size_t stolen = 0;
+        double busySeconds = 0;
+    };
+
+    // A count given by --threads, OMP_NUM_THREADS (the scaling runs of SearchBenchmark) or the descriptor is
+    // taken as is. Otherwise there is one thread per MB of input up to the CPUs the process may use, and they
+    // come out of the budget shared with the searches running next to this one.
+    size_t threadCount() {
+        if (request_.strategy != Strategy::Serial) {
+            if (request_.threads) return request_.threads;
+            if (std::getenv("OMP_NUM_THREADS")) return size_t(omp_get_max_threads());
+            if (dataset_.threads) return dataset_.threads;
+        }
+        uintmax_t totalBytes = 0;
+        for (const auto& file : files_) totalBytes += file->size;
+        budget_.acquire(request_.strategy == Strategy::Serial ? 1 : size_t(std::max<uintmax_t>(totalBytes >> 20, 1)));
+        return budget_.size();
+    }
+
+    // Pin a worker to its CPU from the budget before it allocates anything, so its buffers land on its node
+    void placeWorker(size_t worker) const {
+        if (worker < budget_.size()) pinThisThread(budget_.cpus()[worker]);
+    }
+
+    // The first records of a compressed file, decompressed into prefix
+    bool readPrefix(const File& file, std::string& prefix, std::string_view& body) const {
+        StageTimer timer;
+        std::string error;
+        if (!readDecompressedPrefix(file.path, file.compression, 1 << 20, prefix, error)) {
+            std::cerr << "Error: " << file.path << ": " << error << std::endl;
+            return false;
+        }
+        timer.lap(Stage::Read);
+        body = prefix;
+        if (!skipHeaderRows(dataset_, body)) body = std::string_view();
+        return true;
+    }
+
+    // Map one file and find its first record; the mapping is only read when it is touched, so most of the read
+    // time shows up as page faults in tokenize
+    bool mapFile(const File& file, MappedFile& mapping, std::string_view& body) const {
+        StageTimer timer;
+        if (!mapping.open(file.path)) {
+            std::cerr << "Error: File " << file.path << " could not be opened" << std::endl;
+            return false;
+        }
+        timer.lap(Stage::Read);
+        body = mapping.view();
+        if (!skipHeaderRows(dataset_, body)) body = std::string_view();
+        return true;
+    }
+
+    // The header row of the first file, or the custom headers of the dataset
+    bool readHeaders() {
+        if (!dataset_.headerRow) {
+            headers_ = dataset_.headers;
+            return true;
+        }
+        MappedFile mapping;
+        std::string prefix;
+        std::string_view text;
+        StageTimer timer;
+        if (files_[0]->compression != Compression::None) {
+            std::string error;
+            if (!readDecompressedPrefix(files_[0]->path, files_[0]->compression, 1 << 20, prefix, error)) {
+                std::cerr << "Error: " << files_[0]->path << ": " << error << std::endl;
+                return false;
+            }
+            text = prefix;
+        } else if (mapping.open(files_[0]->path)) {
+            text = mapping.view();
+        } else {
+            std::cerr << "Error: Could not open the file " << files_[0]->path << std::endl;
+            return false;
+        }
+        timer.lap(Stage::Read);
+        if (!skipHeaderRows(dataset_, text, &headers_)) {
+            std::cerr << "Error: File " << files_[0]->path << " has fewer than " << dataset_.skipRows + 1 << " lines." << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    size_t findHeader(std::string_view header) const {
+        return size_t(std::find(headers_.begin(), headers_.end(), header) - headers_.begin());
+    }
+
+    // Compile the request against the headers
+    bool prepare() {
+        std::string error;
+        if (request_.kind == RequestKind::Search) {
+            column_ = findHeader(request_.header);
+            lookupValue_ = request_.value;
+            pattern_ = PatternMatcher(request_.value, request_.match, request_.ignoreCase, request_.anyOf, dataset_.delimiter);
+            patternSearch_ = !pattern_.plainEquality();
+        } else if (request_.kind == RequestKind::Query) {
+            query_ = parseQuery(request_.value, headers_, error);
+            if (!query_) {
+                std::cerr << "Error: " << error << std::endl;
+                return false;
+            }
+            // a query uses the index of a column it requires to equal a value
+            if (const QueryNode* equality = requiredEquality(*query_)) {
+                column_ = equality->column;
+                lookupValue_ = equality->value;
+            }
+        } else if (request_.kind == RequestKind::Where) {
+            // the column types are inferred from a sample of the largest file
+            std::vector<ColumnType> types(headers_.size(), ColumnType::Float);
+            const File& largest = **std::max_element(files_.begin(), files_.end(), [](const auto& a, const auto& b) { return a->size < b->size; });
+            MappedFile sample;
+            std::string prefix;
+            std::string_view body;
+            bool read = largest.compression == Compression::None ? mapFile(largest, sample, body) : readPrefix(largest, prefix, body);
+            if (read) types = inferSchema(body, headers_.size(), dataset_.delimiter);
+            std::vector<RangePredicate> predicates;
+            if (!applySchema(dataset_.schema, headers_, types, error) || !applySchema(request_.schema, headers_, types, error) ||
+                !parseRangePredicates(request_.value, headers_, predicates, error)) {
+                std::cerr << "Error: " << error << std::endl;
+                return false;
+            }
+            for (const RangePredicate& predicate : predicates) {
+                if (types[predicate.column] == ColumnType::Text) {
+                    std::cerr << "Error: Column " << headers_[predicate.column] << " is not numeric" << std::endl;
+                    return false;
+                }
+            }
+            scanner_ = std::make_unique<RangeScanner>(predicates, types, dataset_.delimiter);
+        } else if (request_.kind == RequestKind::GroupBy) {
+            if (!parseGroupSpec(request_.header, request_.aggregates, headers_, groupSpec_, error) ||
+                (!request_.filter.empty() && !(filter_ = parseQuery(request_.filter, headers_, error)))) {
+                std::cerr << "Error: " << error << std::endl;
+                return false;
+            }
+            groups_.assign(numThreads_, GroupTable(groupSpec_.valueColumns.size()));
+        }
+
+        // a fresh Bloom filter of the looked up column drops the files that cannot hold the value, only its
+        // sidecar is read
+        if (column_ < headers_.size() && !patternSearch_ && !incremental()) {
+            for (auto& file : files_) {
+                BloomFilter bloom;
+                if (!bloom.open(file->path, headers_[column_]) || bloom.column() != column_) continue;
+                ++bloomFiles_;
+                file->pruned = !bloom.mayContain(lookupValue_);
+                if (file->pruned) ++prunedFiles_;
+            }
+        }
+        // a fresh index of the searched column narrows a file down to its candidate records
+        for (auto& file : files_) {
+            CsvIndex index;
+            file->indexed = file->compression == Compression::None && !patternSearch_ && column_ < headers_.size() &&
+                            index.open(file->path, headers_[column_]) && index.column() == column_;
+        }
+        // otherwise searches and range queries read the columnar cache where there is a fresh one
+        bool cacheable = ((request_.kind == RequestKind::Search && column_ < headers_.size()) || request_.kind == RequestKind::Where) &&
+                         request_.strategy != Strategy::Indexed && !incremental();
+        for (auto& file : files_) {
+            if (!cacheable || file->indexed || file->pruned) continue;
+            file->cache = std::make_unique<ColumnarCache>();
+            if (!file->cache->open(file->path, dataset_, headers_.size())) {
+                file->cache.reset();
+                continue;
+            }
+            ++cachedFiles_;
+            for (const RangePredicate& predicate : scanner_ ? scanner_->predicates() : std::vector<RangePredicate>()) {
+                file->cache->decodeDictionary(predicate.column);
+            }
+        }
+        return true;
+    }
+
+    bool requireIndexes() const {
+        if (column_ >= headers_.size()) {
+            std::cerr << "Error: The indexed strategy needs a search, or a query that requires one column to equal a value" << std::endl;
+            return false;
+        }
+        for (const auto& file : files_) {
+            if (file->indexed || file->pruned) continue;
+            std::cerr << "Error: No fresh index of " << headers_[column_] << " for " << file->path << ", run --build-index first" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Index every file, side by side when there are many, with every thread when there is one
+    int buildIndexes() {
+        size_t column = findHeader(request_.header);
+        if (column == headers_.size()) {
+            std::cerr << "Error: Unknown header " << request_.header << std::endl;
+            return 1;
+        }
+        const bool single = files_.size() == 1;
+        std::atomic<size_t> written(0);
+        #pragma omp parallel for schedule(dynamic) num_threads(numThreads_) if(!single)
+        for (size_t f = 0; f < files_.size(); ++f) {
+            // index offsets point into the file as stored
+            if (files_[f]->compression != Compression::None) {
+                #pragma omp critical
+                std::cerr << "Error: " << files_[f]->path << " is " << compressionName(files_[f]->compression) << " compressed and cannot be indexed" << std::endl;
+                continue;
+            }
+            MappedFile mapping;
+            std::string_view body;
+            if (!mapFile(*files_[f], mapping, body)) continue;
+            // an index the file only grew past since is extended instead of rebuilt
+            if (extendCsvIndex(files_[f]->path, request_.header, column, mapping.view(), dataset_.delimiter, dataset_.trimValues) ||
+                writeCsvIndex(files_[f]->path, request_.header, column, mapping.view(), body, single ? numThreads_ : 1, dataset_.delimiter,
+                              dataset_.trimValues)) {
+                ++written;
+                continue;
+            }
+            #pragma omp critical
+            std::cerr << "Error: Could not write the index for " << files_[f]->path << std::endl;
+        }
+        if (single && written == 1) std::cout << "Index written to " << indexPathFor(files_[0]->path, request_.header) << std::endl;
+        else std::cout << written.load() << " of " << files_.size() << " indexes written" << std::endl;
+        return written == files_.size() ? 0 : 1;
+    }
+
+    // Write the Bloom filter of every file that has no fresh one at the requested rate, side by side;
+    // compressed files are decompressed to read their values
+    int buildBloomFilters() {
+        size_t column = findHeader(request_.header);
+        if (column == headers_.size()) {
+            std::cerr << "Error: Unknown header " << request_.header << std::endl;
+            return 1;
+        }
+        std::atomic<size_t> written(0);
+        std::atomic<size_t> fresh(0);
+        #pragma omp parallel for schedule(dynamic) num_threads(numThreads_)
+        for (size_t f = 0; f < files_.size(); ++f) {
+            const File& file = *files_[f];
+            BloomFilter existing;
+            if (existing.open(file.path, request_.header) && existing.column() == column &&
+                std::abs(existing.falsePositiveRate() - request_.falsePositiveRate) < 1e-12) {
+                ++fresh;
+                continue;
+            }
+            MappedFile mapping;
+            std::string decompressed;
+            std::string_view body;
+            std::string error;
+            if (file.compression == Compression::None ? !mapFile(file, mapping, body)
+                                                      : !readDecompressedPrefix(file.path, file.compression, std::string::npos, decompressed, error)) {
+                #pragma omp critical
+                std::cerr << "Error: " << file.path << " could not be read " << error << std::endl;
+                continue;
+            }
+            if (file.compression != Compression::None) {
+                body = decompressed;
+                if (!skipHeaderRows(dataset_, body)) body = std::string_view();
+            }
+            if (writeBloomFilter(file.path, request_.header, column, body, request_.falsePositiveRate, dataset_.delimiter, dataset_.trimValues)) {
+                ++written;
+                continue;
+            }
+            #pragma omp critical
+            std::cerr << "Error: Could not write the Bloom filter for " << file.path << std::endl;
+        }
+        std::cout << written.load() << " Bloom filters written, " << fresh.load() << " of " << files_.size() << " files had a fresh one" << std::endl;
+        return written + fresh == files_.size() ? 0 : 1;
+    }
+
+    // Write the columnar cache of every file, side by side; compressed files are decompressed first and the
+    // cache stands in for them from then on
+    int convertFiles() {
+        std::atomic<size_t> written(0);
+        #pragma omp parallel for schedule(dynamic) num_threads(numThreads_)
+        for (size_t f = 0; f < files_.size(); ++f) {
+            const File& file = *files_[f];
+            MappedFile mapping;
+            std::string decompressed;
+            std::string_view text;
+            std::string error;
+            if (file.compression == Compression::None && mapping.open(file.path)) {
+                text = mapping.view();
+            } else if (file.compression == Compression::None ||
+                       !readDecompressedPrefix(file.path, file.compression, std::string::npos, decompressed, error)) {
+                #pragma omp critical
+                std::cerr << "Error: " << file.path << " could not be read " << error << std::endl;
+                continue;
+            } else {
+                text = decompressed;
+            }
+            std::string_view body = text;
+            if (!skipHeaderRows(dataset_, body)) body = std::string_view();
+            if (writeColumnarCache(file.path, text, body, headers_.size(), dataset_)) {
+                ++written;
+                continue;
+            }
+            #pragma omp critical
+            std::cerr << "Error: Could not write the columnar cache for " << file.path << std::endl;
+        }
+        if (files_.size() == 1 && written == 1) std::cout << "Columnar cache written to " << columnarPathFor(files_[0]->path) << std::endl;
+        else std::cout << written.load() << " of " << files_.size() << " columnar caches written" << std::endl;
+        return written == files_.size() ? 0 : 1;
+    }
+
+    // Files much bigger than the average share of a task are cut into record-aligned byte ranges, unless they
+    // have a fresh index, and cached files into ranges of blocks. Tasks come out largest first.
+    std::vector<Task> planTasks() {
+        std::vector<size_t> order(files_.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return files_[a]->size > files_[b]->size; });
+        uintmax_t totalBytes = 0;
+        for (const auto& file : files_) totalBytes += file->size;
+        const uintmax_t taskBytes = std::max<uintmax_t>(totalBytes / (numThreads_ * 8), 1 << 20);
+
+        std::vector<Task> tasks;
+        CsvTokenizer tokenizer(dataset_.delimiter);
+        for (size_t f : order) {
+            File& file = *files_[f];
+            if (file.pruned) continue;
+            if (file.cache) {
+                size_t blocks = file.cache->blockCount();
+                size_t pieces = std::min<size_t>(std::max<uintmax_t>(file.size / taskBytes, 1), std::max<size_t>(blocks, 1));
+                for (size_t p = 0; p < pieces; ++p) {
+                    tasks.push_back({f, false, blocks * p / pieces, blocks * (p + 1) / pieces - blocks * p / pieces});
+                }
+                continue;
+            }
+            if (file.compression != Compression::None) continue;
+            if (numThreads_ > 1 && !file.indexed && request_.strategy != Strategy::Indexed && file.size > 2 * taskBytes) {
+                file.mapping = std::make_unique<MappedFile>();
+                std::string_view body;
+                if (mapFile(file, *file.mapping, body)) {
+                    const char* base = file.mapping->view().data();
+                    for (std::string_view range : tokenizer.splitIntoRecordRanges(body, (body.size() + taskBytes - 1) / taskBytes)) {
+                        tasks.push_back({f, false, size_t(range.data() - base), range.size()});
+                    }
+                    continue;
+                }
+            }
+            tasks.push_back({f, true, 0, 0});
+        }
+        return tasks;
+    }
+
+    // Tasks are dealt round-robin in size order and idle threads steal from the others
+    bool runTasks(const std::vector<Task>& tasks) {
+        WorkStealingQueues<Task> queues(numThreads_);
+        for (size_t i = 0; i < tasks.size(); ++i) queues.push(i % numThreads_, tasks[i]);
+        std::vector<WorkerStats> stats(numThreads_);
+        auto scanStart = std::chrono::high_resolution_clock::now();
+
+        #pragma omp parallel num_threads(numThreads_)
+        {
+            size_t worker = size_t(omp_get_thread_num());
+            placeWorker(worker);
+            Task task;
+            bool stolen = false;
+            while (queues.pop(worker, task, &stolen)) {
+                auto taskStart = std::chrono::high_resolution_clock::now();
+                runTask(task, worker);
+                stats[worker].busySeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - taskStart).count();
+                stats[worker].tasks++;
+                stats[worker].stolen += stolen ? 1 : 0;
+            }
+        }
+
+        if (request_.stats && numThreads_ > 1) {
+            double scanSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - scanStart).count();
+            std::cerr << files_.size() << " files, " << tasks.size() << " tasks, " << scanSeconds << " seconds" << std::endl;
+            for (size_t i = 0; i < stats.size(); ++i) {
+                if (i < budget_.size()) std::cerr << "cpu " << budget_.cpus()[i] << " ";
+                std::cerr << "thread " << i << ": " << stats[i].tasks << " tasks (" << stats[i].stolen << " stolen), busy "
+                          << stats[i].busySeconds << " s, idle " << std::max(0.0, scanSeconds - stats[i].busySeconds) << " s" << std::endl;
+            }
+        }
+        return true;
+    }
+
+    void runTask(const Task& task, size_t worker) {
+        File& file = *files_[task.file];
+        if (stopped(file)) return;
+        if (file.cache) {
+            scanCache(task.file, task.wholeFile ? 0 : task.begin, task.wholeFile ? file.cache->blockCount() : task.begin + task.length);
+            return;
+        }
+        if (!task.wholeFile) {
+            scanRange(task.file, file.mapping->view().substr(task.begin, task.length), task.begin, worker);
+            return;
+        }
+        MappedFile mapping;
+        std::string_view body;
+        if (!mapFile(file, mapping, body)) return;
+        const char* base = mapping.view().data();
+        CsvIndex index;
+        bool indexed = file.indexed && index.open(file.path, headers_[column_]) && index.column() == column_;
+        if (request_.strategy == Strategy::Serial && request_.kind == RequestKind::Search) {
+            searchTable(task.file, mapping, body, indexed ? &index : nullptr);
+            return;
+        }
+        if (!indexed) {
+            scanRange(task.file, body, uint64_t(body.data() - base), worker);
+            return;
+        }
+        for (std::string_view record : index.candidateRecords(mapping.view(), lookupValue_, dataset_.delimiter)) {
+            if (scanRange(task.file, record, uint64_t(record.data() - base), worker)) return;
+        }
+    }
+
+    // Stream the files one after the other: reads are queued ahead of the parser threads, which only ever see
+    // whole records. Files with a fresh index are looked up instead.
+    bool streamFiles() {
+        bool ok = true;
+        bool fellBack = false;
+        for (size_t f = 0; f < files_.size(); ++f) {
+            File& file = *files_[f];
+            if (stopped(file)) break;
+            if (file.pruned) continue;
+            if (file.indexed || file.cache) {
+                runTask({f, true, 0, 0}, 0);
+                continue;
+            }
+            if (file.compression != Compression::None) continue;
+            uint64_t offset = 0;
+            {
+                MappedFile mapping;
+                std::string_view body;
+                if (!mapFile(file, mapping, body)) continue;
+                offset = body.empty() ? mapping.size() : uint64_t(body.data() - mapping.view().data());
+            }
+            std::string backend;
+            auto parse = [&](std::string_view chunk, uint64_t chunkOffset) { scanRange(f, chunk, chunkOffset, 0); };
+            const std::atomic<bool>* stop = request_.mode == MatchMode::First ? &matchFound_ : request_.mode == MatchMode::FirstPerFile ? &file.done : nullptr;
+            if (!streamRecords(file.path, dataset_.delimiter, offset, request_.readOptions, numThreads_, parse, stop, backend)) {
+                std::cerr << "Error: Could not read the file " << file.path << std::endl;
+                ok = false;
+                continue;
+            }
+            fellBack = fellBack || (request_.readOptions.backend == IoBackend::Uring && backend != "uring");
+        }
+        if (fellBack) std::cerr << "Note: io_uring is not available, the files were read with pread" << std::endl;
+        return ok;
+    }
+
+    // Compressed files are decompressed front to back, one after the other, while the parser threads scan the
+    // decompressed chunks. Offsets of matches count decompressed bytes.
+    bool scanCompressedFiles() {
+        bool ok = true;
+        for (size_t f = 0; f < files_.size(); ++f) {
+            File& file = *files_[f];
+            if (file.compression == Compression::None || file.cache || file.pruned) continue;
+            if (stopped(file)) break;
+            ok = scanCompressedFile(f) && ok;
+        }
+        return ok;
+    }
+
+    bool scanCompressedFile(size_t f) {
+        File& file = *files_[f];
+        auto parse = [&](std::string_view chunk, uint64_t offset, size_t parser) { scanRange(f, chunk, offset, parser); };
+        const std::atomic<bool>* stop = request_.mode == MatchMode::First ? &matchFound_ : request_.mode == MatchMode::FirstPerFile ? &file.done : nullptr;
+        std::string error;
+        size_t headerRows = dataset_.skipRows + (dataset_.headerRow ? 1 : 0);
+        if (!streamCompressedRecords(file.path, file.compression, dataset_.delimiter, headerRows, numThreads_, numThreads_,
+                                     request_.readOptions.blockSize, parse, stop, error)) {
+            std::cerr << "Error: " << file.path << ": " << error << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // --state and --follow: every pass scans what was appended past the high-water marks, and with --follow the
+    // next pass starts once inotify reports a change in the dataset's directories. Rows of a pass are printed
+    // when it ends and a group-by prints its running totals after every pass that read something. CPUs from
+    // the budget are only held while a pass runs.
+    int followFiles() {
+        HighWaterMarks marks;
+        std::string error;
+        if (!request_.statePath.empty() && !marks.load(request_.statePath, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+        DatasetWatch watch;
+        if (request_.follow) {
+            std::vector<std::string> paths;
+            for (const auto& file : files_) paths.push_back(file->path);
+            watch.open(dataset_, paths);
+            if (watch.polling()) std::cerr << "Note: inotify is not available, the files are checked once a second" << std::endl;
+        }
+        const size_t threads = numThreads_;
+        const bool budgeted = budget_.size() > 0;
+        for (bool first = true;; first = false) {
+            std::vector<Task> tasks;
+            std::vector<size_t> grown;
+            bool ok = planAppended(marks, threads, tasks, grown);
+            if (budgeted && !tasks.empty()) {
+                budget_.acquire(std::min(threads, tasks.size()));
+                numThreads_ = budget_.size();
+            }
+            if (!tasks.empty()) runTasks(tasks);
+            // the sidecar index of the searched column follows the appends
+            for (size_t f : grown) {
+                if (column_ < headers_.size()) {
+                    extendCsvIndex(files_[f]->path, headers_[column_], column_, files_[f]->mapping->view(), dataset_.delimiter, dataset_.trimValues);
+                }
+                files_[f]->mapping.reset();
+            }
+            sink_->finish();
+            if (!request_.statePath.empty() && !marks.save(request_.statePath)) {
+                std::cerr << "Error: Could not write " << request_.statePath << std::endl;
+                return 1;
+            }
+            if (first) printSummary();
+            else if (request_.kind == RequestKind::GroupBy && !grown.empty()) printGroups();
+            if (!request_.follow || !ok || (request_.mode == MatchMode::First && matchFound_.load())) return ok ? 0 : 1;
+
+            if (budgeted) budget_.release();
+            watch.wait();
+            sink_ = std::make_unique<ResultSink>(request_.ordered);
+        }
+    }
+
+    // New files join the dataset, and the complete records past the mark of every file are cut into tasks of
+    // about a MB; a last line without its line break may still be written and waits for the next pass. A file
+    // still short of its header rows is left for later, compressed files are read whole once.
+    bool planAppended(HighWaterMarks& marks, size_t threads, std::vector<Task>& tasks, std::vector<size_t>& grown) {
+        for (const std::string& path : datasetFiles(dataset_)) {
+            if (std::any_of(files_.begin(), files_.end(), [&](const auto& file) { return file->path == path; })) continue;
+            files_.push_back(std::make_unique<File>());
+            files_.back()->path = path;
+            files_.back()->compression = detectCompression(path);
+        }
+        bool ok = true;
+        CsvTokenizer tokenizer(dataset_.delimiter);
+        for (size_t f = 0; f < files_.size(); ++f) {
+            File& file = *files_[f];
+            std::error_code ec;
+            file.size = std::filesystem::file_size(file.path, ec);
+            if (ec) continue;
+            uint64_t inode = fileInode(file.path);
+            uint64_t from = marks.resumeOffset(file.path, inode, file.size);
+            if (file.compression != Compression::None) {
+                if (from == 0) ok = scanCompressedFile(f) && ok;
+                marks.set(file.path, inode, file.size);
+                continue;
+            }
+            if (from >= file.size) continue;
+            file.mapping = std::make_unique<MappedFile>();
+            std::string_view body;
+            if (!mapFile(file, *file.mapping, body) || !body.data()) {
+                file.mapping.reset();
+                continue;
+            }
+            std::string_view text = file.mapping->view();
+            uint64_t begin = std::max<uint64_t>(from, uint64_t(body.data() - text.data()));
+            std::string_view appended = text.substr(begin);
+            uint64_t end = begin + (!appended.empty() && appended.back() == '\n' ? appended.size() : tokenizer.lastRecordEnd(appended));
+            marks.set(file.path, inode, end);
+            if (end == begin) {
+                file.mapping.reset();
+                continue;
+            }
+            grown.push_back(f);
+            size_t pieces = std::min<size_t>(std::max<uint64_t>((end - begin) >> 20, 1), threads * 8);
+            for (std::string_view range : tokenizer.splitIntoRecordRanges(text.substr(begin, end - begin), pieces)) {
+                tasks.push_back({f, false, size_t(range.data() - text.data()), range.size()});
+            }
+        }
+        return ok;
+    }
+
+    // Scan a byte range of file number source that starts at byte offset base. Returns true once the file needs
+    // no further scanning.
+    bool scanRange(size_t source, std::string_view text, uint64_t base, size_t worker) {
+        if (request_.kind == RequestKind::GroupBy) {
+            aggregateRecords(text, groupSpec_, groups_[worker], filter_.get(), dataset_.delimiter, dataset_.trimValues);
+            return false;
+        }
+        if (scanner_) return scanWhere(source, text, base);
+        if (query_) return scanQuery(source, text, base);
+        if (patternSearch_) return scanPattern(source, text, base);
+        return scanSearch(source, text, base);
+    }
+
+    bool stopped(const File& file) const {
+        return (request_.mode == MatchMode::First && matchFound_.load(std::memory_order_relaxed)) ||
+               (request_.mode == MatchMode::FirstPerFile && file.done.load(std::memory_order_relaxed));
+    }
+
+    // Claim a match without a lock, in the "first" modes only the thread that flips the flag prints
+    bool claimMatch(File& file) {
+        if (matchFound_.exchange(true) && request_.mode == MatchMode::First) return false;
+        if (file.done.exchange(true) && request_.mode == MatchMode::FirstPerFile) return false;
+        return true;
+    }
+
+    // Every record is only probed for the searched column and compared in place, the full split happens for
+    // matching records only. Matches are formatted into a buffer of this thread and reach stdout through the
+    // result sink. Parse buffers come from the thread's arena and are handed back when the range is done.
+    bool scanSearch(size_t source, std::string_view text, uint64_t base) {
+        File& file = *files_[source];
+        ScratchScope scratch;
+        CsvTokenizer tokenizer(dataset_.delimiter);
+        CsvFields row(scratch.arena());
+        RecordProbe probe;
+        ResultBuffer output(*sink_, source);
+        StageTimer timer;
+        const char* textStart = text.data();
+        while (!text.empty()) {
+            if (stopped(file)) return true;
+
+            uint64_t offset = base + uint64_t(text.data() - textStart);
+            tokenizer.probeRecord(text, column_, probe);
+            timer.lap(Stage::Tokenize);
+            bool match = probe.hasField && fieldEquals(dataset_.trimValues ? trimSpaces(probe.field) : probe.field, lookupValue_);
+            timer.lap(Stage::Filter);
+            if (!match) continue;
+            if (!claimMatch(file)) return true;
+
+            tokenizer.splitLine(probe.record, row);
+            timer.lap(Stage::Materialize);
+            appendMatch(output.beginRow(offset), row);
+            timer.lap(Stage::Emit);
+            if (request_.mode != MatchMode::All) return true;
+        }
+        return false;
+    }
+
+    // prefix, substring and case-insensitive counterpart of scanSearch: the raw buffer is filtered for the terms
+    // first and only the records around a hit are probed
+    bool scanPattern(size_t source, std::string_view text, uint64_t base) {
+        File& file = *files_[source];
+        ScratchScope scratch;
+        CsvTokenizer tokenizer(dataset_.delimiter);
+        CsvFields row(scratch.arena());
+        ResultBuffer output(*sink_, source);
+        StageTimer timer;
+        bool done = false;
+        const std::atomic<bool>* stop = request_.mode == MatchMode::First ? &matchFound_ : request_.mode == MatchMode::FirstPerFile ? &file.done : nullptr;
+        findPatternRecords(tokenizer, pattern_, text, column_, dataset_.trimValues, row, [&](std::string_view record) {
+            timer.lap(Stage::Filter);
+            if (!claimMatch(file)) {
+                done = true;
+                return false;
+            }
+            tokenizer.splitLine(record, row);
+            timer.lap(Stage::Materialize);
+            appendMatch(output.beginRow(base + uint64_t(record.data() - text.data())), row);
+            timer.lap(Stage::Emit);
+            done = request_.mode != MatchMode::All;
+            return !done;
+        }, stop);
+        timer.lap(Stage::Filter);
+        return done;
+    }
+
+    // query counterpart of scanSearch: the predicate tree is evaluated on every record in one pass
+    bool scanQuery(size_t source, std::string_view text, uint64_t base) {
+        File& file = *files_[source];
+        ScratchScope scratch;
+        QueryEvaluator evaluator(*query_, scratch.arena(), dataset_.delimiter, dataset_.trimValues);
+        ResultBuffer output(*sink_, source);
+        StageTimer timer;
+        const char* textStart = text.data();
+        std::string_view record;
+        while (!text.empty()) {
+            if (stopped(file)) return true;
+
+            uint64_t offset = base + uint64_t(text.data() - textStart);
+            if (!evaluator.next(text, record, &timer)) continue;
+            if (!claimMatch(file)) return true;
+
+            const CsvFields& row = evaluator.fields();
+            timer.lap(Stage::Materialize);
+            appendMatch(output.beginRow(offset), row);
+            timer.lap(Stage::Emit);
+            if (request_.mode != MatchMode::All) return true;
+        }
+        return false;
+    }
+
+    // range query counterpart of scanSearch, the predicate columns are decoded in batches
+    bool scanWhere(size_t source, std::string_view text, uint64_t base) {
+        File& file = *files_[source];
+        ScratchScope scratch;
+        CsvTokenizer tokenizer(dataset_.delimiter);
+        CsvFields row(scratch.arena());
+        ResultBuffer output(*sink_, source);
+        bool done = false;
+        const std::atomic<bool>* stop = request_.mode == MatchMode::First ? &matchFound_ : request_.mode == MatchMode::FirstPerFile ? &file.done : nullptr;
+        scanner_->scan(text, [&](std::string_view record) {
+            if (!claimMatch(file)) {
+                done = true;
+                return false;
+            }
+            tokenizer.splitLine(record, row);
+            appendMatch(output.beginRow(base + uint64_t(record.data() - text.data())), row);
+            done = request_.mode != MatchMode::All;
+            return !done;
+        }, stop, scratch.arena());
+        return done;
+    }
+
+    // Searches and range queries on a file with a columnar cache: the zone maps rule out whole blocks and only
+    // the searched columns are read for the others, the rest of a row is looked up once it matched
+    void scanCache(size_t source, size_t firstBlock, size_t endBlock) {
+        File& file = *files_[source];
+        const ColumnarCache& cache = *file.cache;
+        ResultBuffer output(*sink_, source);
+        StageTimer timer;
+        char number[32];
+        auto emit = [&](size_t row) {
+            timer.lap(Stage::Filter);
+            if (!claimMatch(file)) return false;
+            appendMatch(output.beginRow(cache.rowOffset(row)), cache.rowWidth(row), [&](size_t i) { return cache.cell(row, i, number); });
+            timer.lap(Stage::Emit);
+            return request_.mode == MatchMode::All;
+        };
+        const std::atomic<bool>* stop = request_.mode == MatchMode::First ? &matchFound_ : request_.mode == MatchMode::FirstPerFile ? &file.done : nullptr;
+        size_t skipped = scanner_ ? cache.findInRanges(scanner_->predicates(), scanner_->filter(), firstBlock, endBlock, emit, stop)
+                         : patternSearch_ ? cache.findMatching(column_, pattern_, firstBlock, endBlock, emit, stop)
+                                          : cache.findEqual(column_, lookupValue_, firstBlock, endBlock, emit, stop);
+        timer.lap(Stage::Filter);
+        skippedBlocks_ += skipped;
+    }
+
+    // Serial strategy: the records of the file, or the candidates of its index, are read into a column-oriented
+    // table first, and the filter then only touches the searched column
+    void searchTable(size_t source, const MappedFile& mapping, std::string_view body, const CsvIndex* index) {
+        File& file = *files_[source];
+        CsvTokenizer tokenizer(dataset_.delimiter);
+        CsvFields fields;
+        StageTimer timer;
+        ColumnTable table(headers_);
+        std::vector<std::string_view> records;
+        if (index) {
+            records = index->candidateRecords(mapping.view(), lookupValue_, dataset_.delimiter);
+        } else {
+            records.push_back(body);
+            table.reserve(0, body.size());
+        }
+        for (std::string_view range : records) {
+            while (tokenizer.nextRecord(range, fields)) {
+                timer.lap(Stage::Tokenize);
+                for (size_t i = 0; i < fields.size(); ++i) {
+                    table.appendCell(dataset_.trimValues ? trimSpaces(fields[i]) : fields[i]);
+                }
+                table.endRow();
+                timer.lap(Stage::Materialize);
+            }
+        }
+
+        ResultBuffer output(*sink_, source);
+        for (size_t row = 0; row < table.rowCount(); ++row) {
+            if (!table.hasCell(row, column_)) continue;
+            std::string_view cell = table.cell(row, column_);
+            if (patternSearch_ ? !pattern_.matches(cell) : cell != lookupValue_) continue;
+            timer.lap(Stage::Filter);
+            if (!claimMatch(file)) return;
+            appendMatch(output.beginRow(row), table.rowWidth(row), [&](size_t i) { return table.cell(row, i); });
+            timer.lap(Stage::Emit);
+            if (request_.mode != MatchMode::All) return;
+        }
+        timer.lap(Stage::Filter);
+    }
+
+    // Format one matching row; cell(i) returns the value of column i for i < width
+    template <class CellFn>
+    void appendMatch(std::string& out, size_t width, CellFn cell) const {
+        if (request_.format != OutputFormat::Text) {
+            appendRow(out, request_.format, headers_, width, cell);
+            return;
+        }
+        //if the width is the one of the headers map it, otherwise return the data as is
+        if (width != headers_.size()) out += "Row with mismatched size:\n";
+        for (size_t i = 0; i < width && i < headers_.size(); ++i) {
+            out.append(headers_[i]).append(": ").append(cell(i)).append(" | ");
+        }
+        out += '\n';
+    }
+
+    void appendMatch(std::string& out, const CsvFields& row) const {
+        size_t width = row.size();
+        // a delimiter at the end of every line leaves one empty field past the last header
+        if (width == headers_.size() + 1 && row[width - 1].empty()) --width;
+        appendMatch(out, width, [&](size_t i) { return dataset_.trimValues ? trimSpaces(row[i]) : row[i]; });
+    }
+
+    std::string noMatch() const {
+        if (request_.kind == RequestKind::Search && patternSearch_) {
+            return "No match found for " + request_.header + " " + matchKindName(request_.match) + (request_.ignoreCase ? " (ignoring case) " : " ") +
+                   request_.value;
+        }
+        if (request_.kind == RequestKind::Search) return "No match found for " + request_.header + " = " + request_.value;
+        return "No match found for " + request_.value;
+    }
+
+    //timings are free text, they go to stderr when stdout carries structured rows
+    void printTime() const {
+        std::chrono::duration<double> executionTime = std::chrono::high_resolution_clock::now() - start_;
+        summary_ << "Time spent: " << executionTime.count() << " seconds" << std::endl;
+    }
+
+    const DatasetDescriptor& dataset_;
+    const SearchRequest& request_;
+    std::ostream& summary_;
+    std::chrono::high_resolution_clock::time_point start_ = std::chrono::high_resolution_clock::now();
+    std::vector<std::unique_ptr<File>> files_;
+    std::vector<std::string> headers_;
+    CpuBudget budget_; // empty when the thread count was given
+    size_t numThreads_ = 1;
+
+    size_t column_ = ~size_t(0); // column compared against lookupValue_, by a search or a query's equality
+    std::string lookupValue_;
+    PatternMatcher pattern_; // terms of a search that is not a plain equality
+    bool patternSearch_ = false;
+    std::unique_ptr<QueryNode> query_;
+    std::unique_ptr<RangeScanner> scanner_;
+    GroupSpec groupSpec_;
+    std::unique_ptr<QueryNode> filter_;
+    std::vector<GroupTable> groups_; // one per worker thread
+
+    std::unique_ptr<ResultSink> sink_;
+    std::unique_ptr<ResultCache> results_; // only with a cache directory
+    std::string resultKey_;
+    uint64_t fingerprint_ = 0;
+    std::atomic<bool> matchFound_{false};
+    size_t cachedFiles_ = 0;
+    std::atomic<size_t> skippedBlocks_{0};
+    size_t bloomFiles_ = 0;
+    size_t prunedFiles_ = 0;
+};
+
+// main() of the search binaries: argv holds "<header> <value> [options]" and the dataset is fixed
+inline int searchMain(int argc, char* argv[], const DatasetDescriptor& dataset, Strategy strategy) {
+    if (argc < 3 && !(argc == 2 && std::string_view(argv[1]) == "--convert")) {
+        std::cout << "No search keyword entered" << std::endl;
+        return 1;
+    }
+    SearchRequest request;
+    request.strategy = strategy;
+    std::string error;
+    if (!parseSearchArgs(argc, argv, dataset, request, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return 1;
+    }
+    return SearchEngine(dataset, request).run();
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string_view>
+
+// How many matching rows a search reports
+enum class MatchMode {
+    First,        // stop every thread as soon as one row matches
+    FirstPerFile, // one row per file for directory datasets
+    All           // every matching row
+};
+
+// Optional mode argument after the search value, returns false for anything it does not recognise
+inline bool parseMatchMode(std::string_view arg, MatchMode& mode) {
+    if (arg == "first") mode = MatchMode::First;
+    else if (arg == "first-per-file") mode = MatchMode::FirstPerFile;
+    else if (arg == "all") mode = MatchMode::All;
+    else return false;
+    return true;
+}
+
+inline const char* matchModeName(MatchMode mode) {
+    switch (mode) {
+        case MatchMode::FirstPerFile: return "first-per-file";
+        case MatchMode::All: return "all";
+        default: return "first";
+    }
+}
@@ -0,0 +1,754 @@
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <map>
+#include <atomic>
+#include <csignal>
+#include <omp.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+#include "MappedFile.h"
+#include "CsvTokenizer.h"
+#include "SearchMode.h"
+#include "CsvIndex.h"
+#include "ResultSink.h"
+#include "Dataset.h"
+#include "CompressedReader.h"
+#include "CpuBudget.h"
+#include "PatternMatch.h"
+#include "ResultCache.h"
+#include "Endpoint.h"
+
+using namespace std;
+
+// Resident search server: every dataset is mapped (compressed files decompressed into memory) and parsed once,
+// and an in-memory hash index per searched column is built on first use. Requests arrive over a Unix domain
+// socket as one line
+//     <dataset>\t<header>\t<value>[\t<first|all|first-per-file>[\t<text|ndjson|csv>[\t<exact|prefix|contains>[\t<flags>]]]]\n
+// and the answer is what the Data* binaries print in that format, after which the connection is closed. An
+// empty mode keeps the dataset's default. Flags is a comma separated list of ignore-case and any-of (the value
+// is a '|' separated list of terms); searches other than a plain equality scan the files instead of the index.
+// Answers are kept in a result cache (ResultCache.h) until a file of their dataset changes, and the line
+//     stats\n
+// returns its hit and miss counters as "<name> <count>" lines.
+//
+// The datasets can also be split over several servers, on this machine or others (Endpoint.h):
+//     SearchServer <socket|host:port> --shard=<i>/<n> [dataset...]
+// only loads shard i of n of every dataset, and
+//     SearchServer <socket|host:port> --workers=<address>,... [dataset...]
+//     SearchServer <socket|host:port> --local-workers=<n> [dataset...]
+// runs a coordinator that answers the same lines by sending them to every shard server at once and merging
+// the rows in shard order; --local-workers starts n shard servers of its own on <socket>.<i> or on the loopback
+// ports after its own. In first mode the coordinator keeps the answer of the earliest shard with a match, as a
+// single server would, and hangs up on the shards after it, which stop searching. A shard that has not answered
+// within --worker-timeout=<seconds> (60) fails the request. Shards answer the coordinator's lines (flag shard)
+// with a "matched <0|1>" line followed by the rows only.
+//
+// Requests are not authenticated. A TCP address without a host listens on loopback only, and a wildcard host
+// such as *:7300 is refused unless --listen-any is given as well.
+
+// Where a value lives: file number inside the dataset and byte offset of its record
+struct IndexEntry {
+    uint64_t hash;
+    uint32_t file;
+    uint64_t offset;
+
+    bool operator<(const IndexEntry& other) const {
+        if (hash != other.hash) return hash < other.hash;
+        if (file != other.file) return file < other.file;
+        return offset < other.offset;
+    }
+};
+
+struct DataFile {
+    string path;
+    FileStamp stamp;
+    MappedFile mapping;
+    string decompressed; // whole content of a gzip or zstd file, which cannot be mapped as text
+    string_view text;    // mapping or decompressed
+    string_view body;    // records after the header rows
+};
+
+// Shard index of count: a dataset of one file is cut into count record-aligned byte ranges of its body, the
+// path ordered files of a larger one into count runs of consecutive files. Either way the shards hold the
+// records in dataset order, so rows merged in shard order and the earliest shard's first match are those of a
+// single server. Every shard server has to see the same paths.
+struct ShardSpec {
+    size_t index = 0;
+    size_t count = 1;
+};
+
+bool parseShard(const string& spec, ShardSpec& shard) {
+    size_t slash = spec.find('/');
+    if (slash == string::npos || spec.find_first_not_of("0123456789/") != string::npos) return false;
+    shard.index = size_t(atoll(spec.substr(0, slash).c_str()));
+    shard.count = size_t(atoll(spec.substr(slash + 1).c_str()));
+    return shard.count > 0 && shard.index < shard.count;
+}
+
+struct Dataset {
+    DatasetDescriptor descriptor; // the one the Data* binaries search
+    ShardSpec shard;
+    vector<string> headers;
+
+    mutex lock;
+    vector<string> paths; // every file listed when loaded, including unreadable ones
+    vector<unique_ptr<DataFile>> files;
+    map<size_t, vector<IndexEntry>> indexes; // column -> entries sorted by hash
+};
+
+// (Re)map every file of the dataset's shard and read its header, existing indexes are dropped. False when
+// the shard has files but none of them could be read.
+bool loadDataset(Dataset& dataset) {
+    dataset.files.clear();
+    dataset.indexes.clear();
+    dataset.paths = datasetFiles(dataset.descriptor);
+    const ShardSpec& shard = dataset.shard;
+    const bool byteRanges = shard.count > 1 && dataset.paths.size() == 1;
+    size_t owned = 0;
+    for (size_t p = 0; p < dataset.paths.size(); ++p) {
+        const string& path = dataset.paths[p];
+        if (!byteRanges && p * shard.count / dataset.paths.size() != shard.index) continue;
+        ++owned;
+        auto file = make_unique<DataFile>();
+        file->path = path;
+        if (!file->stamp.read(path) || !file->mapping.open(path)) {
+            cerr << "Error: File " << path << " could not be opened" << endl;
+            continue;
+        }
+        file->text = file->mapping.view();
+        Compression compression = detectCompression(path);
+        if (compression != Compression::None) {
+            string error;
+            if (!readDecompressedPrefix(path, compression, string::npos, file->decompressed, error)) {
+                cerr << "Error: " << path << ": " << error << endl;
+                continue;
+            }
+            file->text = file->decompressed;
+        }
+        file->body = file->text;
+        if (!skipHeaderRows(dataset.descriptor, file->body, &dataset.headers)) file->body = string_view();
+        if (byteRanges) {
+            // every shard server cuts the same body the same way
+            vector<string_view> ranges = CsvTokenizer(dataset.descriptor.delimiter).splitIntoRecordRanges(file->body, shard.count);
+            file->body = shard.index < ranges.size() ? ranges[shard.index] : string_view();
+        }
+        dataset.files.push_back(move(file));
+    }
+    return owned == 0 || !dataset.files.empty();
+}
+
+// Remap the dataset when any of its files changed size or mtime since it was loaded
+void refreshIfChanged(Dataset& dataset) {
+    // new files count as a change too, as they do for the result cache
+    if (datasetFiles(dataset.descriptor) != dataset.paths) {
+        loadDataset(dataset);
+        return;
+    }
+    for (const auto& file : dataset.files) {
+        FileStamp stamp;
+        if (!stamp.read(file->path) || !(stamp == file->stamp)) {
+            loadDataset(dataset);
+            return;
+        }
+    }
+}
+
+// Hash every value of one column of every file, in parallel over record-aligned ranges, on the CPUs the
+// budget shared with the standalone searches leaves free
+vector<IndexEntry> buildIndex(const Dataset& dataset, size_t column) {
+    CpuBudget budget;
+    budget.acquire(placementCpus().size());
+    CsvTokenizer tokenizer(dataset.descriptor.delimiter);
+    vector<pair<uint32_t, string_view>> ranges;
+    for (uint32_t f = 0; f < dataset.files.size(); ++f) {
+        for (string_view range : tokenizer.splitIntoRecordRanges(dataset.files[f]->body, budget.size())) {
+            ranges.push_back({f, range});
+        }
+    }
+    vector<vector<IndexEntry>> partials(ranges.size());
+    #pragma omp parallel for schedule(dynamic) num_threads(budget.size())
+    for (size_t r = 0; r < ranges.size(); ++r) {
+        const char* base = dataset.files[ranges[r].first]->text.data();
+        string_view range = ranges[r].second;
+        RecordProbe probe;
+        while (!range.empty()) {
+            uint64_t offset = uint64_t(range.data() - base);
+            tokenizer.probeRecord(range, column, probe);
+            if (!probe.hasField) continue;
+            string_view field = dataset.descriptor.trimValues ? trimSpaces(probe.field) : probe.field;
+            partials[r].push_back({hashFieldValue(field), ranges[r].first, offset});
+        }
+    }
+    vector<IndexEntry> entries;
+    for (const auto& partial : partials) entries.insert(entries.end(), partial.begin(), partial.end());
+    sort(entries.begin(), entries.end());
+    return entries;
+}
+
+void printRow(ostream& out, const Dataset& dataset, const CsvFields& row, OutputFormat format) {
+    const vector<string>& headers = dataset.headers;
+    if (format != OutputFormat::Text) {
+        string line;
+        appendRow(line, format, headers, row.size(), [&](size_t i) { return dataset.descriptor.trimValues ? trimSpaces(row[i]) : row[i]; });
+        out << line;
+        return;
+    }
+    if (row.size() < headers.size()) out << "Row with mismatched size:" << endl;
+    for (size_t i = 0; i < headers.size() && i < row.size(); ++i) {
+        out << headers[i] << ": " << (dataset.descriptor.trimValues ? trimSpaces(row[i]) : row[i]) << " | ";
+    }
+    out << endl;
+}
+
+// Prefix, substring and case-insensitive matches of one column, found by filtering the raw file bodies
+size_t searchPattern(ostream& out, const Dataset& dataset, size_t column, const PatternMatcher& pattern, MatchMode mode, OutputFormat format,
+                     const atomic<bool>& stop) {
+    CsvTokenizer tokenizer(dataset.descriptor.delimiter);
+    CsvFields row;
+    size_t matches = 0;
+    for (const auto& file : dataset.files) {
+        if (stop.load(memory_order_relaxed)) break;
+        bool fileDone = false;
+        findPatternRecords(tokenizer, pattern, file->body, column, dataset.descriptor.trimValues, row, [&](string_view record) {
+            tokenizer.splitLine(record, row);
+            printRow(out, dataset, row, format);
+            ++matches;
+            fileDone = mode != MatchMode::All;
+            return !fileDone;
+        }, &stop);
+        if (fileDone && mode == MatchMode::First) break;
+    }
+    return matches;
+}
+
+vector<string> splitTabs(const string& line) {
+    vector<string> parts;
+    size_t begin = 0;
+    while (true) {
+        size_t pos = line.find('\t', begin);
+        parts.push_back(line.substr(begin, pos == string::npos ? string::npos : pos - begin));
+        if (pos == string::npos) break;
+        begin = pos + 1;
+    }
+    return parts;
+}
+
+// One request line; an empty mode is left to the dataset's default
+struct ServerRequest {
+    string dataset;
+    string header;
+    string value;
+    bool modeGiven = false;
+    MatchMode mode = MatchMode::First;
+    OutputFormat format = OutputFormat::Text;
+    MatchKind kind = MatchKind::Exact;
+    bool ignoreCase = false;
+    bool anyOf = false;
+    bool shard = false; // sent by a coordinator
+};
+
+bool parseRequest(const string& line, ServerRequest& request, string& error) {
+    vector<string> parts = splitTabs(line);
+    if (parts.size() < 3) {
+        error = "expected <dataset>\\t<header>\\t<value>[\\t<mode>[\\t<format>[\\t<match>[\\t<flags>]]]]";
+        return false;
+    }
+    request.dataset = parts[0];
+    request.header = parts[1];
+    request.value = parts[2];
+    for (const string& flag : splitList(parts.size() > 6 ? parts[6] : "")) {
+        if (flag == "ignore-case") request.ignoreCase = true;
+        else if (flag == "any-of") request.anyOf = true;
+        else if (flag == "shard") request.shard = true;
+        else if (!flag.empty()) error = "Unknown flag " + flag;
+    }
+    request.modeGiven = parts.size() > 3 && !parts[3].empty();
+    if (request.modeGiven && !parseMatchMode(parts[3], request.mode)) {
+        error = "Unknown match mode " + parts[3];
+    } else if (parts.size() > 4 && !parts[4].empty() && !parseOutputFormat(parts[4], request.format)) {
+        error = "Unknown output format " + parts[4];
+    } else if (parts.size() > 5 && !parts[5].empty() && !parseMatchKind(parts[5], request.kind)) {
+        error = "Unknown match kind " + parts[5];
+    }
+    return error.empty();
+}
+
+// The line a coordinator sends to the shards for request
+string shardRequestLine(const ServerRequest& request, MatchMode mode) {
+    string flags = "shard";
+    if (request.ignoreCase) flags += ",ignore-case";
+    if (request.anyOf) flags += ",any-of";
+    return request.dataset + "\t" + request.header + "\t" + request.value + "\t" + matchModeName(mode) + "\t" + outputFormatName(request.format) +
+           "\t" + matchKindName(request.kind) + "\t" + flags + "\n";
+}
+
+string noMatchLine(const ServerRequest& request) {
+    if (request.kind != MatchKind::Exact || request.ignoreCase || request.anyOf) {
+        return "No match found for " + request.header + " " + matchKindName(request.kind) + (request.ignoreCase ? " (ignoring case) " : " ") +
+               request.value + "\n";
+    }
+    return "No match found for " + request.header + " = " + request.value + "\n";
+}
+
+// The rows answering one request, without the no-match and timing lines. Returns false when stop was raised
+// before the search was through, the rows are then incomplete.
+bool search(Dataset& dataset, const ServerRequest& request, const PatternMatcher& pattern, const atomic<bool>& stop, CachedResult& result) {
+    ostringstream out;
+    lock_guard<mutex> guard(dataset.lock);
+    refreshIfChanged(dataset);
+    if (request.format == OutputFormat::Csv) out << csvHeaderLine(dataset.headers);
+
+    size_t column = find(dataset.headers.begin(), dataset.headers.end(), request.header) - dataset.headers.begin();
+    size_t matches = 0;
+    if (column < dataset.headers.size() && !pattern.plainEquality()) {
+        matches = searchPattern(out, dataset, column, pattern, request.mode, request.format, stop);
+    } else if (column < dataset.headers.size()) {
+        // an index build is not cut short, the next request uses it
+        auto index = dataset.indexes.find(column);
+        if (index == dataset.indexes.end()) {
+            index = dataset.indexes.emplace(column, buildIndex(dataset, column)).first;
+        }
+        const vector<IndexEntry>& entries = index->second;
+        IndexEntry key{hashValue(request.value), 0, 0};
+        auto it = lower_bound(entries.begin(), entries.end(), key);
+
+        CsvTokenizer tokenizer(dataset.descriptor.delimiter);
+        CsvFields row;
+        RecordProbe probe;
+        uint32_t lastFile = ~uint32_t(0);
+        for (; it != entries.end() && it->hash == key.hash && !stop.load(memory_order_relaxed); ++it) {
+            if (request.mode == MatchMode::FirstPerFile && it->file == lastFile) continue;
+            string_view rest = dataset.files[it->file]->text.substr(it->offset);
+            tokenizer.probeRecord(rest, column, probe);
+            string_view field = dataset.descriptor.trimValues ? trimSpaces(probe.field) : probe.field;
+            if (!probe.hasField || !fieldEquals(field, request.value)) continue;
+
+            tokenizer.splitLine(probe.record, row);
+            printRow(out, dataset, row, request.format);
+            lastFile = it->file;
+            ++matches;
+            if (request.mode == MatchMode::First) break;
+        }
+    }
+    result.rows = out.str();
+    result.matched = matches > 0;
+    return !stop.load();
+}
+
+string cacheStats(const ResultCache& results) {
+    ResultCacheCounters counters = results.counters();
+    ostringstream out;
+    out << "hits " << counters.hits << "\nmisses " << counters.misses << "\ndisk_hits " << counters.diskHits << "\nevictions "
+        << counters.evictions << "\nentries " << counters.entries << "\nbytes " << counters.bytes << "\n";
+    return out.str();
+}
+
+// Everything up to the first line break, without it
+string readRequestLine(int client) {
+    string request;
+    char buffer[4096];
+    ssize_t n;
+    while (request.find('\n') == string::npos && (n = read(client, buffer, sizeof(buffer))) > 0) {
+        request.append(buffer, size_t(n));
+    }
+    request = request.substr(0, request.find('\n'));
+    if (!request.empty() && request.back() == '\r') request.pop_back();
+    return request;
+}
+
+string timeLine(chrono::high_resolution_clock::time_point start) {
+    chrono::duration<double> executionTime = chrono::high_resolution_clock::now() - start;
+    ostringstream time;
+    time << "Time spent: " << executionTime.count() << " seconds" << endl;
+    return time.str();
+}
+
+// Raises stop once the client hung up while its answer is searched for; a coordinator does that to the
+// shards that are still looking for a first match another shard found
+class HangupWatch {
+public:
+    HangupWatch(int client, atomic<bool>& stop) : wake_(eventfd(0, EFD_CLOEXEC)), thread_([this, client, &stop] {
+        pollfd events[2] = {{client, POLLRDHUP, 0}, {wake_, POLLIN, 0}};
+        while (poll(events, 2, -1) < 0 && errno == EINTR) {}
+        if (events[0].revents & (POLLRDHUP | POLLHUP | POLLERR)) stop = true;
+    }) {}
+    HangupWatch(const HangupWatch&) = delete;
+    HangupWatch& operator=(const HangupWatch&) = delete;
+    ~HangupWatch() {
+        uint64_t one = 1;
+        if (write(wake_, &one, sizeof(one)) < 0) {}
+        thread_.join();
+        close(wake_);
+    }
+
+private:
+    int wake_;
+    thread thread_;
+};
+
+void serveClient(int client, map<string, unique_ptr<Dataset>>& datasets, ResultCache& results) {
+    auto start = chrono::high_resolution_clock::now();
+    string line = readRequestLine(client);
+
+    string response;
+    ServerRequest request;
+    string error;
+    auto dataset = datasets.end();
+    if (line == "stats") {
+        response = cacheStats(results);
+    } else if (!parseRequest(line, request, error)) {
+        response = "Error: " + error + "\n";
+    } else if ((dataset = datasets.find(request.dataset)) == datasets.end()) {
+        response = "Error: Unknown dataset " + request.dataset + "\n";
+    } else {
+        if (!request.modeGiven) request.mode = dataset->second->descriptor.defaultMode;
+        // a hit only stats the files, it neither waits for the dataset's lock nor reads a record
+        // shard servers share the cache directory they inherit, so the shard is part of the key
+        const ShardSpec& shard = dataset->second->shard;
+        string key = resultKey({request.dataset, request.header, request.value, to_string(int(request.mode)), to_string(int(request.format)),
+                                matchKindName(request.kind), request.ignoreCase ? "ignore-case" : "", request.anyOf ? "any-of" : "",
+                                "shard " + to_string(shard.index) + "/" + to_string(shard.count)});
+        uint64_t fingerprint = fingerprintFiles(datasetFiles(dataset->second->descriptor));
+        CachedResult result;
+        if (!results.get(key, fingerprint, result)) {
+            PatternMatcher pattern(request.value, request.kind, request.ignoreCase, request.anyOf, dataset->second->descriptor.delimiter);
+            atomic<bool> stop(false);
+            bool complete;
+            {
+                unique_ptr<HangupWatch> watch;
+                if (request.shard && request.mode == MatchMode::First) watch = make_unique<HangupWatch>(client, stop);
+                complete = search(*dataset->second, request, pattern, stop, result);
+            }
+            // nobody waits for the rows of a cancelled search, and they are not complete enough to keep
+            if (!complete) {
+                close(client);
+                return;
+            }
+            results.put(key, fingerprint, result);
+        }
+        if (request.shard) {
+            response = string("matched ") + (result.matched ? "1" : "0") + "\n" + result.rows;
+        } else {
+            response = result.rows;
+            //structured formats carry rows only
+            if (request.format == OutputFormat::Text && !result.matched) response += noMatchLine(request);
+            if (request.format == OutputFormat::Text) response += timeLine(start);
+        }
+    }
+    writeAll(client, response);
+    close(client);
+}
+
+// Send line to every worker at once and read their answers side by side, in worker order. With cancelFirst
+// the earliest shard with a match wins, as on a single server: once shard i answered with a match the
+// connections to the shards after it are closed, which stops their search, and winner is set to i when every
+// shard before it answered without one. A worker that has not answered by the deadline fails the round.
+bool scatter(const vector<Endpoint>& workers, const string& line, bool cancelFirst, chrono::milliseconds timeout, vector<string>& answers,
+             size_t& winner, string& error) {
+    vector<pollfd> peers;
+    answers.assign(workers.size(), string());
+    winner = string::npos;
+    for (const Endpoint& worker : workers) {
+        int fd = connectTo(worker);
+        if (fd < 0 || !writeAll(fd, line)) {
+            if (fd >= 0) close(fd);
+            for (const pollfd& peer : peers) close(peer.fd);
+            error = "Worker " + worker.spec() + " is not reachable";
+            return false;
+        }
+        peers.push_back({fd, POLLIN, 0});
+    }
+    auto deadline = chrono::steady_clock::now() + timeout;
+    size_t first = peers.size(); // earliest shard that answered with a match
+    // the first shard still reading that the answer depends on, npos once there is none
+    auto pending = [&] {
+        for (size_t i = 0; i < first; ++i) {
+            if (peers[i].fd >= 0) return i;
+        }
+        return string::npos;
+    };
+    char buffer[65536];
+    for (size_t waiting = pending(); waiting != string::npos; waiting = pending()) {
+        auto left = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+        int ready = left > 0 ? poll(peers.data(), peers.size(), int(left)) : 0;
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready < 0) {
+            error = "Lost the workers' answers";
+            break;
+        }
+        if (ready == 0) {
+            error = "Worker " + workers[waiting].spec() + " did not answer";
+            break;
+        }
+        for (size_t i = 0; i < peers.size(); ++i) {
+            if (peers[i].fd < 0 || !peers[i].revents) continue;
+            ssize_t n = read(peers[i].fd, buffer, sizeof(buffer));
+            if (n > 0) {
+                answers[i].append(buffer, size_t(n));
+                continue;
+            }
+            close(peers[i].fd);
+            peers[i].fd = -1; // poll skips it from now on
+            if (cancelFirst && i < first && answers[i].rfind("matched 1\n", 0) == 0) {
+                first = i;
+                for (size_t later = i + 1; later < peers.size(); ++later) {
+                    if (peers[later].fd >= 0) close(peers[later].fd);
+                    peers[later].fd = -1;
+                }
+            }
+        }
+    }
+    for (const pollfd& peer : peers) {
+        if (peer.fd >= 0) close(peer.fd);
+    }
+    // a shard before the match that failed is reported by mergeAnswers, which then looks at every answer
+    bool earlierClean = all_of(answers.begin(), answers.begin() + min(first, answers.size()),
+                               [](const string& answer) { return answer.rfind("matched 0\n", 0) == 0; });
+    if (error.empty() && first < peers.size() && earlierClean) winner = first;
+    return error.empty();
+}
+
+// Rows of every shard in shard order, or of the winner only; a CSV header line is kept once. The error of
+// a shard that failed is the error of the request.
+bool mergeAnswers(const ServerRequest& request, const vector<Endpoint>& workers, const vector<string>& answers, size_t winner, string& merged,
+                  bool& matched, string& error) {
+    string header;
+    string rows;
+    matched = false;
+    for (size_t i = 0; i < answers.size(); ++i) {
+        if (winner != string::npos && i != winner) continue;
+        const string& answer = answers[i];
+        if (answer.rfind("matched ", 0) != 0) {
+            error = answer.rfind("Error: ", 0) == 0 ? answer.substr(7, answer.find('\n') - 7) : "Worker " + workers[i].spec() + " gave no answer";
+            return false;
+        }
+        matched = matched || answer[8] == '1';
+        string_view body = string_view(answer).substr(answer.find('\n') + 1);
+        if (request.format == OutputFormat::Csv) {
+            // a shard without files of the dataset has no headers either
+            size_t end = min(body.find('\n'), body.size() - 1) + 1;
+            if (header.size() <= 1) header = string(body.substr(0, end));
+            body.remove_prefix(end);
+        }
+        rows.append(body);
+    }
+    merged = header + rows;
+    return true;
+}
+
+// The counters of every worker added up
+string gatherStats(const vector<Endpoint>& workers, chrono::milliseconds timeout) {
+    vector<string> answers;
+    size_t winner;
+    string error;
+    if (!scatter(workers, "stats\n", false, timeout, answers, winner, error)) return "Error: " + error + "\n";
+    vector<pair<string, uint64_t>> totals;
+    for (const string& answer : answers) {
+        istringstream lines(answer);
+        string name;
+        uint64_t count;
+        while (lines >> name >> count) {
+            auto total = find_if(totals.begin(), totals.end(), [&](const auto& entry) { return entry.first == name; });
+            if (total == totals.end()) totals.push_back({name, count});
+            else total->second += count;
+        }
+    }
+    ostringstream out;
+    for (const auto& total : totals) out << total.first << " " << total.second << "\n";
+    return out.str();
+}
+
+// Coordinator side of a request: the datasets are only resolved here for their default mode, the shard
+// servers hold the files
+void coordinateClient(int client, const map<string, DatasetDescriptor>& datasets, const vector<Endpoint>& workers,
+                      chrono::milliseconds timeout) {
+    auto start = chrono::high_resolution_clock::now();
+    string line = readRequestLine(client);
+
+    string response;
+    ServerRequest request;
+    string error;
+    auto dataset = datasets.end();
+    if (line == "stats") {
+        response = gatherStats(workers, timeout);
+    } else if (!parseRequest(line, request, error)) {
+        response = "Error: " + error + "\n";
+    } else if ((dataset = datasets.find(request.dataset)) == datasets.end()) {
+        response = "Error: Unknown dataset " + request.dataset + "\n";
+    } else {
+        if (!request.modeGiven) request.mode = dataset->second.defaultMode;
+        // a single file is cut into byte ranges, so its first row per file is its first row
+        if (request.mode == MatchMode::FirstPerFile && datasetFiles(dataset->second).size() == 1) request.mode = MatchMode::First;
+        vector<string> answers;
+        size_t winner;
+        bool matched = false;
+        if (!scatter(workers, shardRequestLine(request, request.mode), request.mode == MatchMode::First, timeout, answers, winner, error) ||
+            !mergeAnswers(request, workers, answers, winner, response, matched, error)) {
+            response = "Error: " + error + "\n";
+        } else if (request.format == OutputFormat::Text) {
+            if (!matched) response += noMatchLine(request);
+            response += timeLine(start);
+        }
+    }
+    writeAll(client, response);
+    close(client);
+}
+
+// --local-workers: run count shard servers of this binary next to the coordinator, on <socket>.<i> or on the
+// loopback ports following its own, and wait until every one of them answers
+bool startLocalWorkers(const Endpoint& endpoint, size_t count, const vector<string>& datasetArgs, vector<Endpoint>& workers) {
+    for (size_t i = 0; i < count; ++i) {
+        Endpoint worker = endpoint;
+        if (worker.tcp) {
+            // only the coordinator talks to them
+            worker.host.clear();
+            worker.port = to_string(stoul(endpoint.port) + 1 + i);
+        } else {
+            worker.path = endpoint.path + "." + to_string(i);
+        }
+        workers.push_back(worker);
+        vector<string> args = {"SearchServer", worker.spec(), "--shard=" + to_string(i) + "/" + to_string(count)};
+        args.insert(args.end(), datasetArgs.begin(), datasetArgs.end());
+        pid_t pid = fork();
+        if (pid < 0) return false;
+        if (pid == 0) {
+            // the shard servers go when the coordinator goes
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            vector<char*> argv;
+            for (string& arg : args) argv.push_back(arg.data());
+            argv.push_back(nullptr);
+            execv("/proc/self/exe", argv.data());
+            _exit(127);
+        }
+    }
+    for (const Endpoint& worker : workers) {
+        // mapping, or decompressing, the datasets may take a while
+        bool ready = false;
+        for (int attempt = 0; attempt < 1200 && !ready; ++attempt) {
+            int fd = connectTo(worker);
+            if (fd >= 0) {
+                ready = writeAll(fd, "stats\n") && shutdown(fd, SHUT_WR) == 0 && readRequestLine(fd).rfind("hits ", 0) == 0;
+                close(fd);
+            }
+            if (!ready) this_thread::sleep_for(chrono::milliseconds(100));
+        }
+        if (!ready) {
+            cerr << "Error: Worker " << worker.spec() << " did not start" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    // the socket may be left out, options and descriptor files follow it
+    bool socketGiven = argc > 1 && string_view(argv[1]).rfind("--", 0) != 0;
+    string socketPath = socketGiven ? argv[1] : "/tmp/csvsearch.sock";
+    signal(SIGPIPE, SIG_IGN);
+
+    ShardSpec shard;
+    vector<Endpoint> workers;
+    size_t localWorkers = 0;
+    bool listenAny = false;
+    chrono::milliseconds workerTimeout = chrono::seconds(60);
+    vector<string> datasetArgs;
+    for (int i = socketGiven ? 2 : 1; i < argc; ++i) {
+        string arg = argv[i];
+        string error;
+        if (arg.rfind("--shard=", 0) == 0) {
+            if (!parseShard(arg.substr(8), shard)) {
+                cerr << "Error: --shard expects <index>/<count> with index < count" << endl;
+                return 1;
+            }
+        } else if (arg.rfind("--workers=", 0) == 0) {
+            for (const string& spec : splitList(arg.substr(10))) {
+                workers.emplace_back();
+                if (!parseEndpoint(spec, workers.back(), error)) {
+                    cerr << "Error: " << error << endl;
+                    return 1;
+                }
+            }
+        } else if (arg.rfind("--local-workers=", 0) == 0) {
+            localWorkers = size_t(max(0, atoi(arg.c_str() + 16)));
+        } else if (arg.rfind("--worker-timeout=", 0) == 0) {
+            workerTimeout = chrono::seconds(max(1, atoi(arg.c_str() + 17)));
+        } else if (arg == "--listen-any") {
+            listenAny = true;
+        } else {
+            datasetArgs.push_back(arg);
+        }
+    }
+    Endpoint endpoint;
+    string error;
+    if (!parseEndpoint(socketPath, endpoint, error)) {
+        cerr << "Error: " << error << endl;
+        return 1;
+    }
+    // nothing checks who sends the requests
+    if (endpoint.anyHost() && !listenAny) {
+        cerr << "Error: " << endpoint.spec() << " lets every host that reaches the port search the datasets, pass --listen-any to allow it" << endl;
+        return 1;
+    }
+    const bool coordinator = !workers.empty() || localWorkers > 0;
+    if (coordinator && shard.count > 1) {
+        cerr << "Error: A coordinator does not hold a shard itself" << endl;
+        return 1;
+    }
+
+    // the built-in datasets, plus any *.dataset descriptor files given after the socket path
+    map<string, DatasetDescriptor> descriptors;
+    vector<string> names = {"data1", "data2", "data3"};
+    names.insert(names.end(), datasetArgs.begin(), datasetArgs.end());
+    for (const string& name : names) {
+        DatasetDescriptor descriptor;
+        if (!resolveDataset(name, descriptor, error)) {
+            cerr << "Error: " << error << endl;
+            return 1;
+        }
+        descriptors[descriptor.name] = descriptor;
+    }
+
+    // a coordinator keeps no answers, its shard servers cache their own parts
+    map<string, unique_ptr<Dataset>> datasets;
+    unique_ptr<ResultCache> results;
+    if (coordinator) {
+        if (localWorkers > 0 && !startLocalWorkers(endpoint, localWorkers, datasetArgs, workers)) return 1;
+    } else {
+        results = make_unique<ResultCache>();
+        for (const auto& entry : descriptors) {
+            auto dataset = make_unique<Dataset>();
+            dataset->descriptor = entry.second;
+            dataset->shard = shard;
+            if (!loadDataset(*dataset)) cerr << "Warning: dataset " << entry.first << " has no readable files" << endl;
+            datasets[entry.first] = move(dataset);
+        }
+    }
+
+    int server = listenOn(endpoint);
+    if (server < 0) {
+        cerr << "Error: Could not listen on " << endpoint.spec() << endl;
+        return 1;
+    }
+    cout << "Listening on " << endpoint.spec();
+    if (coordinator) cout << ", coordinating " << workers.size() << " shard servers";
+    if (shard.count > 1) cout << " as shard " << shard.index << " of " << shard.count;
+    cout << endl;
+
+    // one thread per connection, datasets serialise their own index builds
+    while (true) {
+        int client = acceptClient(server, endpoint);
+        if (client < 0) continue;
+        if (coordinator) thread(coordinateClient, client, cref(descriptors), cref(workers), workerTimeout).detach();
+        else thread(serveClient, client, ref(datasets), ref(*results)).detach();
+    }
+}
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Per-stage instrumentation for --stats. Scan loops hold a StageTimer and call lap(stage) after each step;
+// the ticks since the previous lap are charged to that stage in counters private to the thread, so the
+// timers cost two TSC reads per record and no synchronisation. With --stats off a timer is a null check.
+// Every instrumented thread also opens cycle, cache-miss and branch-miss counters with perf_event_open
+// when the kernel allows it.
+
+enum class Stage { Read, Tokenize, Materialize, Filter, Emit };
+constexpr size_t stageCount = 5;
+
+inline const char* stageName(size_t stage) {
+    static const char* names[stageCount] = {"read", "tokenize", "materialize", "filter", "emit"};
+    return names[stage];
+}
+
+inline uint64_t stageTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+// Set once by enableStageStats() before any scan thread starts
+inline bool stageStatsOn = false;
+
+struct StageClockStart {
+    uint64_t ticks = 0;
+    std::chrono::steady_clock::time_point time;
+};
+
+inline StageClockStart& stageClockStart() {
+    static StageClockStart start;
+    return start;
+}
+
+inline void enableStageStats() {
+    stageStatsOn = true;
+    stageClockStart().ticks = stageTicks();
+    stageClockStart().time = std::chrono::steady_clock::now();
+}
+
+// Cycles, cache misses and branch misses of the calling thread, user space only, read as one group
+class HardwareCounters {
+public:
+    static constexpr size_t count = 3;
+
+    HardwareCounters() = default;
+    HardwareCounters(const HardwareCounters&) = delete;
+    HardwareCounters& operator=(const HardwareCounters&) = delete;
+    ~HardwareCounters() {
+        for (int fd : fds_) {
+            if (fd >= 0) close(fd);
+        }
+    }
+
+    // false with error set when perf events are not permitted or not supported
+    bool open(std::string& error) {
+        static const uint64_t configs[count] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        for (size_t i = 0; i < count; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds_[i] = int(syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds_[0], 0));
+            if (fds_[i] < 0) {
+                error = std::string("perf_event_open: ") + std::strerror(errno);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Counts since open(), scaled up when the kernel had to multiplex the counters
+    bool read(uint64_t values[count]) const {
+        uint64_t data[3 + count];
+        if (fds_[0] < 0 || ::read(fds_[0], data, sizeof(data)) != ssize_t(sizeof(data)) || data[0] != count) return false;
+        double scale = data[2] > 0 ? double(data[1]) / double(data[2]) : 1.0;
+        for (size_t i = 0; i < count; ++i) values[i] = uint64_t(double(data[3 + i]) * scale);
+        return true;
+    }
+
+private:
+    int fds_[count] = {-1, -1, -1};
+};
+
+struct StageTotals {
+    size_t thread = 0;
+    uint64_t ticks[stageCount] = {};
+    uint64_t laps[stageCount] = {};
+    bool hasHardware = false;
+    uint64_t hardware[HardwareCounters::count] = {};
+};
+
+class ThreadStages;
+
+// Live threads plus the totals of the ones that already exited
+struct StageRegistry {
+    std::mutex mutex;
+    std::vector<ThreadStages*> live;
+    std::vector<StageTotals> exited;
+    size_t nextThread = 0;
+    std::string hardwareError;
+};
+
+inline StageRegistry& stageRegistry() {
+    static StageRegistry registry;
+    return registry;
+}
+
+class ThreadStages {
+public:
+    ThreadStages() {
+        std::string error;
+        hardwareOk_ = counters_.open(error);
+        StageRegistry& registry = stageRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        totals.thread = registry.nextThread++;
+        if (!hardwareOk_ && registry.hardwareError.empty()) registry.hardwareError = error;
+        registry.live.push_back(this);
+    }
+
+    ~ThreadStages() {
+        StageRegistry& registry = stageRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.exited.push_back(snapshot());
+        registry.live.erase(std::find(registry.live.begin(), registry.live.end(), this));
+    }
+
+    StageTotals snapshot() const {
+        StageTotals copy = totals;
+        copy.hasHardware = hardwareOk_ && counters_.read(copy.hardware);
+        return copy;
+    }
+
+    StageTotals totals;
+
+private:
+    HardwareCounters counters_;
+    bool hardwareOk_ = false;
+};
+
+inline StageTotals& threadStageTotals() {
+    thread_local ThreadStages stages;
+    return stages.totals;
+}
+
+class StageTimer {
+public:
+    StageTimer() : totals_(stageStatsOn ? &threadStageTotals() : nullptr), last_(totals_ ? stageTicks() : 0) {}
+
+    // Charge the time since the previous lap to stage
+    void lap(Stage stage) {
+        if (!totals_) return;
+        uint64_t now = stageTicks();
+        totals_->ticks[size_t(stage)] += now - last_;
+        ++totals_->laps[size_t(stage)];
+        last_ = now;
+    }
+
+    // Leave the time since the previous lap uncharged
+    void skip() {
+        if (totals_) last_ = stageTicks();
+    }
+
+private:
+    StageTotals* totals_;
+    uint64_t last_;
+};
+
+// Per stage totals over all threads followed by one line per thread. Call once the scan threads are idle.
+inline std::string stageReport() {
+    StageClockStart start = stageClockStart();
+    // the tick rate is measured against the steady clock over at least 10 ms
+    auto minimum = start.time + std::chrono::milliseconds(10);
+    if (std::chrono::steady_clock::now() < minimum) std::this_thread::sleep_until(minimum);
+    uint64_t ticks = stageTicks() - start.ticks;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start.time).count();
+    double ticksPerSecond = seconds > 0 ? double(ticks) / seconds : 1e9;
+
+    StageRegistry& registry = stageRegistry();
+    std::vector<StageTotals> threads;
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        threads = registry.exited;
+        for (const ThreadStages* stages : registry.live) threads.push_back(stages->snapshot());
+    }
+    std::sort(threads.begin(), threads.end(), [](const StageTotals& a, const StageTotals& b) { return a.thread < b.thread; });
+
+    auto stageList = [&](const uint64_t* stageTicks, double total) {
+        std::string out;
+        char buffer[96];
+        for (size_t s = 0; s < stageCount; ++s) {
+            if (stageTicks[s] == 0) continue;
+            double stageSeconds = double(stageTicks[s]) / ticksPerSecond;
+            if (total > 0) std::snprintf(buffer, sizeof(buffer), "%s%s %.6f s (%.1f%%)", out.empty() ? "" : " | ", stageName(s), stageSeconds, 100 * stageSeconds / total);
+            else std::snprintf(buffer, sizeof(buffer), "%s%s %.6f s", out.empty() ? "" : " | ", stageName(s), stageSeconds);
+            out += buffer;
+        }
+        return out;
+    };
+
+    uint64_t sum[stageCount] = {};
+    uint64_t hardware[HardwareCounters::count] = {};
+    bool anyHardware = false;
+    for (const StageTotals& thread : threads) {
+        for (size_t s = 0; s < stageCount; ++s) sum[s] += thread.ticks[s];
+        if (!thread.hasHardware) continue;
+        anyHardware = true;
+        for (size_t h = 0; h < HardwareCounters::count; ++h) hardware[h] += thread.hardware[h];
+    }
+    double total = 0;
+    for (size_t s = 0; s < stageCount; ++s) total += double(sum[s]) / ticksPerSecond;
+
+    std::string out = "Stages over " + std::to_string(threads.size()) + " threads: " + stageList(sum, total) + "\n";
+    char buffer[128];
+    for (const StageTotals& thread : threads) {
+        // threads that never finished a lap, such as idle parsers, only add noise
+        if (std::all_of(thread.ticks, thread.ticks + stageCount, [](uint64_t t) { return t == 0; })) continue;
+        out += "  thread " + std::to_string(thread.thread) + ": " + stageList(thread.ticks, 0);
+        if (thread.hasHardware) {
+            std::snprintf(buffer, sizeof(buffer), " | %.4g cycles, %.4g cache misses, %.4g branch misses", double(thread.hardware[0]),
+                          double(thread.hardware[1]), double(thread.hardware[2]));
+            out += buffer;
+        }
+        out += '\n';
+    }
+    if (anyHardware) {
+        std::snprintf(buffer, sizeof(buffer), "Hardware counters: %.4g cycles, %.4g cache misses, %.4g branch misses\n",
+                      double(hardware[0]), double(hardware[1]), double(hardware[2]));
+        out += buffer;
+    } else if (!threads.empty()) {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        out += "Hardware counters unavailable (" + registry.hardwareError + ")\n";
+    }
+    return out;
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Dataset.h"
+#include "MappedFile.h"
+
+// Incremental scans of datasets that grow by appends. Every file has a high-water mark: the byte offset up to
+// which its records were scanned, together with the inode it was taken on. A pass only reads the complete
+// records past the mark; a file whose inode changed or that shrank below its mark was replaced or truncated
+// and is read again from its first record. The marks are kept in a small text file between runs, and while
+// following, inotify on the dataset's directories says when the next pass is due.
+
+struct HighWaterMark {
+    uint64_t inode = 0;
+    uint64_t offset = 0;
+};
+
+inline uint64_t fileInode(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? uint64_t(st.st_ino) : 0;
+}
+
+// The marks of one dataset, one "<offset> <inode> <path>" line per file
+class HighWaterMarks {
+public:
+    // A missing state file is an empty one, the first run reads everything
+    bool load(const std::string& statePath, std::string& error) {
+        marks_.clear();
+        std::ifstream in(statePath);
+        if (!in) return true;
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            std::istringstream fields(line);
+            HighWaterMark mark;
+            std::string path;
+            if (!(fields >> mark.offset >> mark.inode) || !std::getline(fields >> std::ws, path)) {
+                error = "Bad line in " + statePath + ": " + line;
+                return false;
+            }
+            marks_[path] = mark;
+        }
+        return true;
+    }
+
+    // Written through replaceFile, like the sidecar files
+    bool save(const std::string& statePath) const {
+        return replaceFile(statePath, [&](FILE* out) {
+            bool ok = std::fprintf(out, "# high-water offsets: <offset> <inode> <path>\n") > 0;
+            for (const auto& entry : marks_) {
+                ok = ok && std::fprintf(out, "%llu %llu %s\n", (unsigned long long)entry.second.offset, (unsigned long long)entry.second.inode,
+                                        entry.first.c_str()) > 0;
+            }
+            return ok;
+        });
+    }
+
+    // Where the next pass over path starts, 0 for a new, replaced or truncated file
+    uint64_t resumeOffset(const std::string& path, uint64_t inode, uint64_t size) const {
+        auto found = marks_.find(path);
+        if (found == marks_.end() || found->second.inode != inode || found->second.offset > size) return 0;
+        return found->second.offset;
+    }
+
+    void set(const std::string& path, uint64_t inode, uint64_t offset) { marks_[path] = HighWaterMark{inode, offset}; }
+
+private:
+    std::map<std::string, HighWaterMark> marks_;
+};
+
+// Directories of the dataset under inotify: a directory dataset with all of its subdirectories (new ones are
+// added as they appear), otherwise the directories holding the files. Without inotify the watch falls back
+// to polling once a second.
+class DatasetWatch {
+public:
+    DatasetWatch() = default;
+    DatasetWatch(const DatasetWatch&) = delete;
+    DatasetWatch& operator=(const DatasetWatch&) = delete;
+    ~DatasetWatch() {
+        if (fd_ >= 0) close(fd_);
+    }
+
+    void open(const DatasetDescriptor& dataset, const std::vector<std::string>& files) {
+        fd_ = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+        if (fd_ < 0) return;
+        std::error_code ec;
+        if (std::filesystem::is_directory(dataset.path, ec)) {
+            addTree(dataset.path);
+            return;
+        }
+        // a glob or single file: the fixed part of its directory, and the directories of the current files
+        std::filesystem::path parent = std::filesystem::path(dataset.path).parent_path();
+        if (parent.empty()) parent = ".";
+        if (parent.string().find_first_of("*?[") == std::string::npos) addWatch(parent.string());
+        for (const std::string& file : files) {
+            std::filesystem::path directory = std::filesystem::path(file).parent_path();
+            addWatch(directory.empty() ? "." : directory.string());
+        }
+    }
+
+    bool polling() const { return fd_ < 0; }
+
+    // Block until a watched directory saw a write, a new file or a rename, then let the burst of events of
+    // one append settle before returning
+    void wait() {
+        if (fd_ < 0) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            return;
+        }
+        pollfd ready{fd_, POLLIN, 0};
+        while (!drain()) {
+            if (poll(&ready, 1, -1) < 0 && errno != EINTR) return;
+        }
+        while (poll(&ready, 1, 50) > 0) drain();
+    }
+
+private:
+    void addWatch(const std::string& directory) {
+        int wd = inotify_add_watch(fd_, directory.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO);
+        if (wd >= 0) directories_[wd] = directory;
+    }
+
+    void addTree(const std::string& directory) {
+        addWatch(directory);
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(directory, ec)) {
+            if (entry.is_directory(ec)) addWatch(entry.path().string());
+        }
+    }
+
+    // Read the pending events, true when there were any; new directories are watched from here on
+    bool drain() {
+        alignas(inotify_event) char buffer[16384];
+        bool any = false;
+        ssize_t n;
+        while ((n = read(fd_, buffer, sizeof(buffer))) > 0) {
+            any = true;
+            for (char* p = buffer; p < buffer + n;) {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+                p += sizeof(inotify_event) + event->len;
+                if (!(event->mask & IN_ISDIR) || !(event->mask & (IN_CREATE | IN_MOVED_TO)) || event->len == 0) continue;
+                auto directory = directories_.find(event->wd);
+                if (directory != directories_.end()) addTree(directory->second + "/" + event->name);
+            }
+        }
+        return any;
+    }
+
+    int fd_ = -1;
+    std::map<int, std::string> directories_; // watch descriptor -> path
+};
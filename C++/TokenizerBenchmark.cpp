@@ -0,0 +1,118 @@
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include "MappedFile.h"
+#include "CsvTokenizer.h"
+
+using namespace std;
+using recursive_directory_iterator = std::filesystem::recursive_directory_iterator;
+
+// The split() every search binary used before CsvTokenizer, kept here as the baseline
+vector<string> split(const string &s, char delimiter) {
+    vector<string> tokens;
+    string token;
+    istringstream tokenStream(s);
+    while (getline(tokenStream, token, delimiter)) {
+        tokens.push_back(token);
+    }
+    return tokens;
+}
+
+bool hasCSVExtension(const string& filename) {
+    return filename.size() >= 4 && filename.substr(filename.size() - 4) == ".csv";
+}
+
+// Time one full pass of the legacy split() over every line, returns the number of fields seen
+size_t runLegacySplit(const vector<string_view>& inputs, double& seconds) {
+    auto start = chrono::high_resolution_clock::now();
+    size_t fieldCount = 0;
+    for (string_view text : inputs) {
+        string_view line;
+        while (nextLine(text, line)) {
+            fieldCount += split(string(line), ',').size();
+        }
+    }
+    seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+    return fieldCount;
+}
+
+size_t runTokenizer(const vector<string_view>& inputs, ScanKernel kernel, double& seconds) {
+    auto start = chrono::high_resolution_clock::now();
+    CsvTokenizer tokenizer(',', kernel);
+    CsvFields fields;
+    size_t fieldCount = 0;
+    for (string_view text : inputs) {
+        while (tokenizer.nextRecord(text, fields)) {
+            fieldCount += fields.size();
+        }
+    }
+    seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+    return fieldCount;
+}
+
+void benchmarkDataset(const string& name, const vector<string_view>& inputs, int repetitions) {
+    size_t bytes = 0;
+    for (string_view text : inputs) bytes += text.size();
+    if (bytes == 0) {
+        cout << name << ": no input found" << endl;
+        return;
+    }
+    cout << name << " (" << bytes / (1024.0 * 1024.0) << " MB)" << endl;
+
+    auto report = [&](const string& label, size_t fieldCount, double best) {
+        cout << "  " << label << ": " << best << " s, " << bytes / (1024.0 * 1024.0) / best << " MB/s, " << fieldCount << " fields" << endl;
+    };
+
+    double best = 0;
+    size_t fieldCount = 0;
+    for (int r = 0; r < repetitions; ++r) {
+        double seconds;
+        fieldCount = runLegacySplit(inputs, seconds);
+        if (r == 0 || seconds < best) best = seconds;
+    }
+    report("istringstream split", fieldCount, best);
+
+    for (ScanKernel kernel : {ScanKernel::Scalar, ScanKernel::Sse2, ScanKernel::Avx2}) {
+        if (!scanKernelSupported(kernel)) continue;
+        for (int r = 0; r < repetitions; ++r) {
+            double seconds;
+            fieldCount = runTokenizer(inputs, kernel, seconds);
+            if (r == 0 || seconds < best) best = seconds;
+        }
+        report(string("tokenizer ") + scanKernelName(kernel), fieldCount, best);
+    }
+}
+
+// Compares the old istringstream split() against CsvTokenizer on all three datasets
+int main(int argc, char *argv[]) {
+    int repetitions = argc > 1 ? stoi(argv[1]) : 3;
+
+    MappedFile data1;
+    if (data1.open("../Data Sets/Data1 - World Bank Population Data/API_SP.POP.TOTL_DS2_en_csv_v2_3401680.csv")) {
+        benchmarkDataset("Data1", {data1.view()}, repetitions);
+    }
+
+    vector<unique_ptr<MappedFile>> data2Files;
+    vector<string_view> data2Views;
+    std::error_code ec;
+    for (const auto& entry : recursive_directory_iterator("../Data Sets/Data2 - AirNow 2020 California Complex Fire", ec)) {
+        if (!hasCSVExtension(entry.path().string())) continue;
+        data2Files.push_back(make_unique<MappedFile>());
+        if (data2Files.back()->open(entry.path().string())) {
+            data2Views.push_back(data2Files.back()->view());
+        }
+    }
+    benchmarkDataset("Data2", data2Views, repetitions);
+
+    MappedFile data3;
+    if (data3.open("../Data Sets/Data3 - NYC Data Organization/Parking_Violations_Issued_-_Fiscal_Year_2022.csv")) {
+        benchmarkDataset("Data3", {data3.view()}, repetitions);
+    }
+
+    return 0;
+}
@@ -0,0 +1,295 @@
+#pragma once
+
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "CsvTokenizer.h"
+#include "StageStats.h"
+
+// Typed scan path for numeric columns. A schema gives every column a type, inferred from a sample of records
+// or set on the command line. Range predicates such as "measurement_PM2.5>150" or "lat:32..35" are evaluated
+// on batches of 64 records: the predicate columns are decoded into packed double arrays and compared with
+// SIMD kernels that return one bit per record. Cells that are empty or not numbers decode to NaN and never
+// match.
+
+enum class ColumnType { Text, Int, Float };
+
+inline bool parseColumnType(std::string_view name, ColumnType& type) {
+    if (name == "text") type = ColumnType::Text;
+    else if (name == "int") type = ColumnType::Int;
+    else if (name == "float") type = ColumnType::Float;
+    else return false;
+    return true;
+}
+
+inline const char* columnTypeName(ColumnType type) {
+    switch (type) {
+        case ColumnType::Int: return "int";
+        case ColumnType::Float: return "float";
+        default: return "text";
+    }
+}
+
+// Parse a whole (already unquoted) cell as a number, surrounding spaces allowed. Int cells go through the
+// integer from_chars, which is cheaper than the floating point one.
+inline bool parseNumber(std::string_view cell, ColumnType type, double& value) {
+    while (!cell.empty() && cell.front() == ' ') cell.remove_prefix(1);
+    while (!cell.empty() && cell.back() == ' ') cell.remove_suffix(1);
+    if (cell.empty()) return false;
+    if (cell.front() == '+') cell.remove_prefix(1);
+    const char* end = cell.data() + cell.size();
+    if (type == ColumnType::Int) {
+        int64_t integer;
+        auto result = std::from_chars(cell.data(), end, integer);
+        if (result.ec == std::errc() && result.ptr == end) {
+            value = double(integer);
+            return true;
+        }
+    }
+    auto result = std::from_chars(cell.data(), end, value);
+    return result.ec == std::errc() && result.ptr == end;
+}
+
+inline double decodeCell(std::string_view cell, ColumnType type) {
+    double value;
+    return parseNumber(cell, type, value) ? value : std::numeric_limits<double>::quiet_NaN();
+}
+
+// Type every column from the first sampleRows records of body: int when every non-empty cell is an integer,
+// float when every non-empty cell is a number, text otherwise. Columns that are empty throughout stay text.
+inline std::vector<ColumnType> inferSchema(std::string_view body, size_t columnCount, char delimiter = ',', size_t sampleRows = 1000) {
+    std::vector<ColumnType> types(columnCount, ColumnType::Int);
+    std::vector<bool> seen(columnCount, false);
+    CsvTokenizer tokenizer(delimiter);
+    CsvFields fields;
+    for (size_t row = 0; row < sampleRows && tokenizer.nextRecord(body, fields); ++row) {
+        for (size_t c = 0; c < columnCount && c < fields.size(); ++c) {
+            std::string_view cell = fields[c];
+            if (types[c] == ColumnType::Text || cell.find_first_not_of(' ') == std::string_view::npos) continue;
+            seen[c] = true;
+            double value;
+            if (types[c] == ColumnType::Int && !parseNumber(cell, ColumnType::Int, value)) types[c] = ColumnType::Float;
+            if (types[c] == ColumnType::Float && !parseNumber(cell, ColumnType::Float, value)) types[c] = ColumnType::Text;
+        }
+    }
+    for (size_t c = 0; c < columnCount; ++c) {
+        if (!seen[c]) types[c] = ColumnType::Text;
+    }
+    return types;
+}
+
+// Apply "col:type,col:type" on top of an inferred schema
+inline bool applySchema(std::string_view spec, const std::vector<std::string>& headers, std::vector<ColumnType>& types,
+                        std::string& error) {
+    while (!spec.empty()) {
+        size_t comma = spec.find(',');
+        std::string_view item = spec.substr(0, comma);
+        spec = comma == std::string_view::npos ? std::string_view() : spec.substr(comma + 1);
+        size_t colon = item.rfind(':');
+        ColumnType type;
+        if (colon == std::string_view::npos || !parseColumnType(item.substr(colon + 1), type)) {
+            error = "Bad schema entry " + std::string(item);
+            return false;
+        }
+        std::string_view name = item.substr(0, colon);
+        size_t column = 0;
+        while (column < headers.size() && headers[column] != name) ++column;
+        if (column == headers.size()) {
+            error = "Unknown header " + std::string(name);
+            return false;
+        }
+        types[column] = type;
+    }
+    return true;
+}
+
+// low <= value <= high, either side may be open or unbounded
+struct RangePredicate {
+    size_t column = 0;
+    double low = -std::numeric_limits<double>::infinity();
+    double high = std::numeric_limits<double>::infinity();
+    bool lowInclusive = true;
+    bool highInclusive = true;
+};
+
+// Parse "<header><op><number>" with op one of < <= > >= =, or "<header>:<low>..<high>" (inclusive)
+inline bool parseRangePredicate(std::string_view text, const std::vector<std::string>& headers, RangePredicate& predicate,
+                                std::string& error) {
+    size_t opPos = text.find_first_of("<>=");
+    size_t betweenPos = text.rfind(':');
+    std::string_view name;
+    std::string_view rest;
+    std::string_view op;
+    if (opPos != std::string_view::npos) {
+        name = text.substr(0, opPos);
+        size_t opLength = (opPos + 1 < text.size() && text[opPos + 1] == '=' && text[opPos] != '=') ? 2 : 1;
+        op = text.substr(opPos, opLength);
+        rest = text.substr(opPos + opLength);
+    } else if (betweenPos != std::string_view::npos) {
+        name = text.substr(0, betweenPos);
+        rest = text.substr(betweenPos + 1);
+    } else {
+        error = "Bad predicate " + std::string(text);
+        return false;
+    }
+    predicate = RangePredicate();
+    while (predicate.column < headers.size() && headers[predicate.column] != name) ++predicate.column;
+    if (predicate.column == headers.size()) {
+        error = "Unknown header " + std::string(name);
+        return false;
+    }
+
+    double value;
+    if (op.empty()) {
+        size_t dots = rest.find("..");
+        double high;
+        if (dots == std::string_view::npos || !parseNumber(rest.substr(0, dots), ColumnType::Float, value) ||
+            !parseNumber(rest.substr(dots + 2), ColumnType::Float, high)) {
+            error = "Bad range " + std::string(rest);
+            return false;
+        }
+        predicate.low = value;
+        predicate.high = high;
+        return true;
+    }
+    if (!parseNumber(rest, ColumnType::Float, value)) {
+        error = "Bad number " + std::string(rest);
+        return false;
+    }
+    if (op == "<" || op == "<=") {
+        predicate.high = value;
+        predicate.highInclusive = op == "<=";
+    } else if (op == ">" || op == ">=") {
+        predicate.low = value;
+        predicate.lowInclusive = op == ">=";
+    } else {
+        predicate.low = predicate.high = value;
+    }
+    return true;
+}
+
+// Comma separated list of predicates that must all hold
+inline bool parseRangePredicates(std::string_view text, const std::vector<std::string>& headers,
+                                 std::vector<RangePredicate>& predicates, std::string& error) {
+    predicates.clear();
+    while (!text.empty()) {
+        size_t comma = text.find(',');
+        RangePredicate predicate;
+        if (!parseRangePredicate(text.substr(0, comma), headers, predicate, error)) return false;
+        predicates.push_back(predicate);
+        text = comma == std::string_view::npos ? std::string_view() : text.substr(comma + 1);
+    }
+    if (predicates.empty()) error = "Empty predicate";
+    return !predicates.empty();
+}
+
+using RangeFilterFn = uint64_t (*)(const double* values, size_t count, const RangePredicate& predicate);
+
+// Bit i is set when values[i] lies in the predicate's range, count <= 64
+inline uint64_t filterRangeScalar(const double* values, size_t count, const RangePredicate& p) {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < count; ++i) {
+        double v = values[i];
+        bool aboveLow = p.lowInclusive ? v >= p.low : v > p.low;
+        bool belowHigh = p.highInclusive ? v <= p.high : v < p.high;
+        mask |= uint64_t(aboveLow && belowHigh) << i;
+    }
+    return mask;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Four doubles per compare; ordered compares are false for NaN so undecodable cells drop out
+__attribute__((target("avx2"))) inline uint64_t filterRangeAvx2(const double* values, size_t count, const RangePredicate& p) {
+    const __m256d low = _mm256_set1_pd(p.low);
+    const __m256d high = _mm256_set1_pd(p.high);
+    uint64_t mask = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d v = _mm256_loadu_pd(values + i);
+        __m256d aboveLow = p.lowInclusive ? _mm256_cmp_pd(v, low, _CMP_GE_OQ) : _mm256_cmp_pd(v, low, _CMP_GT_OQ);
+        __m256d belowHigh = p.highInclusive ? _mm256_cmp_pd(v, high, _CMP_LE_OQ) : _mm256_cmp_pd(v, high, _CMP_LT_OQ);
+        mask |= uint64_t(_mm256_movemask_pd(_mm256_and_pd(aboveLow, belowHigh))) << i;
+    }
+    if (i < count) mask |= filterRangeScalar(values + i, count - i, p) << i;
+    return mask;
+}
+#endif
+
+inline RangeFilterFn rangeFilterFor(ScanKernel kernel) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (kernel == ScanKernel::Avx2) return filterRangeAvx2;
+#endif
+    (void)kernel;
+    return filterRangeScalar;
+}
+
+// Scans byte ranges of records for rows that satisfy every predicate
+class RangeScanner {
+public:
+    static constexpr size_t batchSize = 64;
+
+    RangeScanner(std::vector<RangePredicate> predicates, const std::vector<ColumnType>& types, char delimiter = ',',
+                 ScanKernel kernel = detectScanKernel())
+        : predicates_(std::move(predicates)), filter_(rangeFilterFor(kernel)), delimiter_(delimiter) {
+        // every predicate column is decoded once per record even when several predicates use it
+        for (RangePredicate& predicate : predicates_) {
+            size_t slot = 0;
+            while (slot < columns_.size() && columns_[slot] != predicate.column) ++slot;
+            if (slot == columns_.size()) {
+                columns_.push_back(predicate.column);
+                types_.push_back(types[predicate.column]);
+            }
+            slots_.push_back(slot);
+        }
+    }
+
+    const std::vector<RangePredicate>& predicates() const { return predicates_; }
+    RangeFilterFn filter() const { return filter_; }
+
+    // Call onMatch(record) for every matching record of text in file order. onMatch returns false to stop,
+    // stop is checked once per batch. The decode buffers come from arena when one is given. Decoding counts as
+    // the materialize stage and the callbacks as emit.
+    template <class OnMatch>
+    void scan(std::string_view text, OnMatch onMatch, const std::atomic<bool>* stop = nullptr, Arena* arena = nullptr) const {
+        CsvTokenizer tokenizer(delimiter_);
+        CsvFields fields(arena);
+        std::vector<double, ArenaAllocator<double>> values(columns_.size() * batchSize, 0.0, ArenaAllocator<double>(arena));
+        std::string_view records[batchSize];
+        StageTimer timer;
+        while (!text.empty() && !(stop && stop->load(std::memory_order_relaxed))) {
+            size_t count = 0;
+            for (; count < batchSize && tokenizer.nextRecord(text, fields); ++count) {
+                timer.lap(Stage::Tokenize);
+                records[count] = fields.record;
+                for (size_t s = 0; s < columns_.size(); ++s) {
+                    values[s * batchSize + count] = columns_[s] < fields.size() ? decodeCell(fields[columns_[s]], types_[s])
+                                                                                : std::numeric_limits<double>::quiet_NaN();
+                }
+                timer.lap(Stage::Materialize);
+            }
+            uint64_t mask = count == 64 ? ~uint64_t(0) : (uint64_t(1) << count) - 1;
+            for (size_t p = 0; p < predicates_.size() && mask; ++p) {
+                mask &= filter_(&values[slots_[p] * batchSize], count, predicates_[p]);
+            }
+            timer.lap(Stage::Filter);
+            while (mask) {
+                int bit = __builtin_ctzll(mask);
+                mask &= mask - 1;
+                if (!onMatch(records[bit])) return;
+            }
+            timer.lap(Stage::Emit);
+        }
+    }
+
+private:
+    std::vector<RangePredicate> predicates_;
+    std::vector<size_t> columns_;    // distinct predicate columns
+    std::vector<ColumnType> types_;  // their types
+    std::vector<size_t> slots_;      // predicate -> index into columns_
+    RangeFilterFn filter_;
+    char delimiter_;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// One deque per worker thread. A worker takes tasks from the front of its own deque and, once that is empty,
+// steals from the back of the others, so tasks dealt largest-first are started largest-first while thieves
+// pick up the small leftovers.
+template <class Task>
+class WorkStealingQueues {
+public:
+    explicit WorkStealingQueues(size_t numWorkers) : queues_(numWorkers) {}
+
+    size_t size() const { return queues_.size(); }
+
+    void push(size_t worker, Task task) {
+        Queue& queue = queues_[worker % queues_.size()];
+        std::lock_guard<std::mutex> lock(queue.lock);
+        queue.tasks.push_back(std::move(task));
+    }
+
+    // Next task for worker, its own first and then stolen. Returns false once every deque is empty.
+    bool pop(size_t worker, Task& task, bool* stolen = nullptr) {
+        if (takeFront(queues_[worker], task)) {
+            if (stolen) *stolen = false;
+            return true;
+        }
+        for (size_t i = 1; i < queues_.size(); ++i) {
+            if (takeBack(queues_[(worker + i) % queues_.size()], task)) {
+                if (stolen) *stolen = true;
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    static bool takeFront(Queue& queue, Task& task) {
+        std::lock_guard<std::mutex> lock(queue.lock);
+        if (queue.tasks.empty()) return false;
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        return true;
+    }
+
+    static bool takeBack(Queue& queue, Task& task) {
+        std::lock_guard<std::mutex> lock(queue.lock);
+        if (queue.tasks.empty()) return false;
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    std::vector<Queue> queues_;
+};
@@ -0,0 +1,33 @@
+#!/bin/bash
+# Searches pruned by Bloom filters must find the rows of unpruned ones, also after builders of the same
+# sidecars ran at the same time
+source "$(dirname "$0")/lib.sh"
+build CsvSearch
+
+mkdir -p "$WORK/dir"
+for f in $(seq 1 8); do
+    { echo 'id,site,value'; for i in $(seq 1 300); do echo "$f$i, s$(( (f * 7 + i) % 40 )) ,$i"; done; } > "$WORK/dir/f$f.csv"
+done
+printf 'name = sites\npath = %s\ntrim = true\nmode = all\n' "$WORK/dir" > "$WORK/sites.dataset"
+search() { "$BIN/CsvSearch" "$WORK/sites.dataset" "$@" --format=ndjson --ordered 2>/dev/null; }
+
+declare -A before
+for value in s0 s13 s39 nowhere; do before[$value]="$(search site "$value" all)"; done
+
+# concurrent builders must each leave a whole sidecar behind and no temporary files
+for i in 1 2 3 4; do "$BIN/CsvSearch" "$WORK/sites.dataset" --build-bloom site > /dev/null 2>&1 & done
+for i in 1 2 3 4; do "$BIN/CsvSearch" "$WORK/sites.dataset" --build-index site > /dev/null 2>&1 & done
+wait
+expectSame "sidecars" "8 8" "$(ls "$WORK/dir" | grep -c '\.bloom$') $(ls "$WORK/dir" | grep -c '\.idx$')"
+expectSame "temporary files" "" "$(ls "$WORK/dir" | grep tmp)"
+
+for value in s0 s13 s39 nowhere; do
+    [ "$value" != nowhere ] && expectNonEmpty "scan finds $value" "${before[$value]}"
+    expectSame "pruned search for $value" "${before[$value]}" "$(search site "$value" all)"
+    expectSame "indexed search for $value" "${before[$value]}" "$(search site "$value" all --strategy=indexed)"
+    expectSame "pruned query for $value" "${before[$value]}" "$(search --query "site=$value")"
+done
+pruned="$("$BIN/CsvSearch" "$WORK/sites.dataset" site nowhere all --stats 2>&1 | grep -o '^[0-9]* of 8 files pruned')"
+expectSame "filters prune" "8 of 8 files pruned" "$pruned"
+
+finish
@@ -0,0 +1,28 @@
+#!/bin/bash
+# A gzip file of a ';' delimited dataset, or the plain file streamed with --io, must give the rows of the mapped
+# plain file, quoted delimiters and line breaks in the header row and the records included
+source "$(dirname "$0")/lib.sh"
+echo 'int main() {}' | "$CXX" -x c++ - -o /dev/null -lz 2>/dev/null || { echo "skipped: no zlib"; exit 0; }
+build CsvSearch CsvSearchZ -DCSV_WITH_ZLIB -lz
+
+mkdir -p "$WORK/plain" "$WORK/gz"
+{
+    printf 'id;"city\nname";note\n'
+    for i in $(seq 1 200); do printf '%d;c%d;"a;b\nc%d"\n' "$i" $((i % 7)) "$i"; done
+} > "$WORK/plain/s.csv"
+gzip -c "$WORK/plain/s.csv" > "$WORK/gz/s.csv.gz"
+for kind in plain gz; do
+    printf 'name = %s\npath = %s\ndelimiter = ;\nmode = all\n' "$kind" "$WORK/$kind" > "$WORK/$kind.dataset"
+done
+search() { "$BIN/CsvSearchZ" "$WORK/$1.dataset" "${@:2}" --format=ndjson --ordered 2>/dev/null; }
+
+plain="$(search plain "city
+name" c3 all)"
+expectNonEmpty "plain search" "$plain"
+expectSame "gzip search" "$plain" "$(search gz "city
+name" c3 all)"
+expectSame "streamed search" "$plain" "$(search plain "city
+name" c3 all --io=pread)"
+expectSame "gzip query" "$(search plain --query "id>150")" "$(search gz --query "id>150")"
+
+finish
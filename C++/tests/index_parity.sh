@@ -0,0 +1,22 @@
+#!/bin/bash
+# An indexed search must find exactly the rows a full scan finds, on trimmed datasets too
+source "$(dirname "$0")/lib.sh"
+build CsvSearch
+
+dataset="$(writeTrimDataset)"
+search() { "$BIN/CsvSearch" "$dataset" "$@" --format=ndjson --ordered 2>/dev/null; }
+
+for value in Cuba Peru Chile Aruba Nowhere; do
+    scanned="$(search name "$value" all --strategy=parallel)"
+    [ "$value" != Nowhere ] && expectNonEmpty "scan finds $value" "$scanned"
+    "$BIN/CsvSearch" "$dataset" --build-index name > /dev/null 2>&1
+    expectSame "indexed search for $value" "$scanned" "$(search name "$value" all --strategy=indexed)"
+    expectSame "first match for $value" "$(search name "$value" first --strategy=parallel)" "$(search name "$value" first --strategy=indexed)"
+done
+
+# an index extended with appended records hashes them the same way
+printf '7, Cuba,5\n' >> "$WORK/trim/t.csv"
+"$BIN/CsvSearch" "$dataset" --build-index name > /dev/null 2>&1
+expectSame "extended index" "$(search name Cuba all --strategy=parallel)" "$(search name Cuba all --strategy=indexed)"
+
+finish
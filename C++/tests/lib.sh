@@ -0,0 +1,103 @@
+# Shared helpers of the regression scripts in this directory. Each script sources this file, builds the
+# programs it needs once into $BIN (a temporary directory unless set) and works on data in $WORK.
+set -u
+
+TESTS_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+SRC_DIR="$(dirname "$TESTS_DIR")"
+CXX="${CXX:-g++}"
+CXXFLAGS="${CXXFLAGS:--std=c++17 -O2 -fopenmp}"
+WORK="$(mktemp -d /tmp/csvtest.XXXXXX)"
+BIN="${BIN:-$WORK/bin}"
+FAILURES=0
+mkdir -p "$BIN"
+export CSV_CPU_BUDGET_DIR="$WORK/cpus"
+unset CSV_RESULT_CACHE_DIR
+trap 'rm -rf "$WORK"' EXIT
+
+# build <program> [<name> <flags>...]: compile C++/<program>.cpp into $BIN/<name> (the program by default)
+# unless it is already there; the flags go after the source, e.g. -DCSV_WITH_ZLIB -lz
+build() {
+    local program="$1" name="${2:-$1}"
+    shift $(($# < 2 ? $# : 2))
+    [ -x "$BIN/$name" ] && return 0
+    "$CXX" $CXXFLAGS "$SRC_DIR/$program.cpp" -o "$BIN/$name" "$@" || { echo "FAIL: cannot build $name"; exit 1; }
+}
+
+# expectSame <what> <expected> <actual>
+expectSame() {
+    if [ "$2" == "$3" ]; then
+        echo "ok   $1"
+    else
+        echo "FAIL $1"
+        diff <(printf '%s\n' "$2") <(printf '%s\n' "$3") | head -20
+        FAILURES=$((FAILURES + 1))
+    fi
+}
+
+# expectNonEmpty <what> <actual>: guards a parity check against two equally empty answers
+expectNonEmpty() {
+    if [ -n "$2" ]; then
+        echo "ok   $1"
+    else
+        echo "FAIL $1: empty"
+        FAILURES=$((FAILURES + 1))
+    fi
+}
+
+finish() {
+    [ "$FAILURES" -eq 0 ] && echo "passed" || echo "$FAILURES failed"
+    exit $((FAILURES > 0))
+}
+
+# A small dataset whose cells carry the padding trimmed datasets such as Data1 have
+writeTrimDataset() {
+    mkdir -p "$WORK/trim"
+    printf 'id,name,pop\n1, Cuba ,11\n2,  Peru,33\n3,Chile  ,19\n4, Cuba ,12\n5,Aruba,1\n6,  Peru ,40\n' > "$WORK/trim/t.csv"
+    printf 'name = trimmed\npath = %s\ntrim = true\nmode = all\n' "$WORK/trim/t.csv" > "$WORK/trim/t.dataset"
+    echo "$WORK/trim/t.dataset"
+}
+
+# ask <address> <request line>: send one line to a search server and print its answer; "\t" stands for a tab
+ask() {
+    python3 - "$1" "$2" <<'PY'
+import socket, sys
+address, line = sys.argv[1], sys.argv[2].replace('\\t', '\t')
+host, separator, port = address.rpartition(':')
+if separator and '/' not in address:
+    client = socket.create_connection((host or 'localhost', int(port)))
+else:
+    client = socket.socket(socket.AF_UNIX)
+    client.connect(address)
+# a server that never answers fails the script instead of hanging it
+client.settimeout(120)
+client.sendall((line + '\n').encode())
+chunks = []
+while True:
+    chunk = client.recv(65536)
+    if not chunk:
+        break
+    chunks.append(chunk)
+sys.stdout.write(b''.join(chunks).decode())
+PY
+}
+
+# startServer <address> <args>...: run SearchServer in the background until the script exits and wait until it
+# answers
+startServer() {
+    local address="$1"
+    "$BIN/SearchServer" "$@" > /dev/null 2>&1 &
+    SERVERS="${SERVERS:-} $!"
+    trap 'kill $SERVERS 2>/dev/null; wait 2>/dev/null; rm -rf "$WORK"' EXIT
+    for i in $(seq 300); do
+        ask "$address" stats > /dev/null 2>&1 && return 0
+        sleep 0.1
+    done
+    echo "FAIL: no server on $address"
+    exit 1
+}
+
+stopServers() {
+    kill $SERVERS 2>/dev/null
+    wait 2>/dev/null
+    SERVERS=""
+}
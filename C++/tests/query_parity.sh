@@ -0,0 +1,22 @@
+#!/bin/bash
+# --query and --group-by must see the cells a plain search sees, on trimmed datasets too
+source "$(dirname "$0")/lib.sh"
+build CsvSearch
+
+dataset="$(writeTrimDataset)"
+search() { "$BIN/CsvSearch" "$dataset" "$@" --format=ndjson --ordered 2>/dev/null; }
+
+for value in Cuba Peru Chile Aruba; do
+    scanned="$(search name "$value" all)"
+    expectNonEmpty "scan finds $value" "$scanned"
+    expectSame "query name=$value" "$scanned" "$(search --query "name=$value")"
+    expectSame "query with a second column" "$scanned" "$(search --query "pop>0 AND name=$value")"
+    # the group of the value holds as many rows as the search found, filtered or not
+    rows="$(printf '%s\n' "$scanned" | grep -c .)"
+    expectSame "group-by count of $value" "{\"name\":\"$value\",\"count\":\"$rows\"}" "$(search --group-by name | grep "\"name\":\"$value\"")"
+    expectSame "filtered group-by of $value" "$rows" \
+        "$(search --group-by pop --filter="name=$value" | grep -o '"count":"[0-9]*"' | tr -dc '0-9\n' | awk '{ n += $1 } END { print n }')"
+done
+expectSame "group-by keys" "$(printf '%s\n' Aruba Chile Cuba Peru)" "$(search --group-by name | grep -o '"name":"[^"]*"' | cut -d'"' -f4 | sort)"
+
+finish
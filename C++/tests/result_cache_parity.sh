@@ -0,0 +1,20 @@
+#!/bin/bash
+# Answers replayed from the result cache must be byte for byte the answers of the run that stored them
+source "$(dirname "$0")/lib.sh"
+build CsvSearch
+
+dataset="$(writeTrimDataset)"
+cache="$WORK/cache"
+search() { CSV_RESULT_CACHE_DIR="$cache" "$BIN/CsvSearch" "$dataset" "$@" 2>/dev/null | grep -v "^Time spent"; }
+
+for format in text ndjson csv; do
+    for args in "name Cuba all" "name Peru first" "name Nowhere all" "pop 1 all --match=prefix"; do
+        fresh="$(search $args --format=$format --ordered)"
+        [ "$args" != "name Nowhere all" ] && expectNonEmpty "$format $args" "$fresh"
+        hit="$(CSV_RESULT_CACHE_DIR="$cache" "$BIN/CsvSearch" "$dataset" $args --format=$format --ordered --stats 2>&1 >/dev/null | grep -c "result cache: hit")"
+        expectSame "$format $args is cached" 1 "$hit"
+        expectSame "$format $args from the cache" "$fresh" "$(search $args --format=$format --ordered)"
+    done
+done
+
+finish
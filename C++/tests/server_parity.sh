@@ -0,0 +1,70 @@
+#!/bin/bash
+# A coordinator over shard servers must answer exactly what one server holding everything answers, also when
+# the answers come from a result cache directory the shard servers share across a restart, and a shard that
+# never answers must fail the request instead of hanging it
+source "$(dirname "$0")/lib.sh"
+build SearchServer
+
+# one file, cut into byte ranges by the shards, and a directory, whose files are dealt out in runs
+mkdir -p "$WORK/one" "$WORK/dir" "$WORK/late" "$WORK/latedir"
+awk 'BEGIN { print "id,plate,state"; for (i = 1; i <= 3000; ++i) print i ",P" (i % 50) ",S" (i % 7) }' > "$WORK/one/p.csv"
+for f in $(seq 1 6); do
+    awk -v f=$f 'BEGIN { print "id,plate,state"; for (i = 1; i <= 200; ++i) print f i ",P" ((f + i) % 50) ",S" (i % 7) }' > "$WORK/dir/f$f.csv"
+done
+# first matches that come late in the first shard and early in the later ones, so the first shard to answer
+# with a match is not the one holding the dataset's first match
+awk 'BEGIN { print "id,plate"; for (i = 1; i <= 300000; ++i) print i "," (i == 99000 || i == 100010 || i == 200010 ? "NEEDLE" : "P" i) }' \
+    > "$WORK/late/l.csv"
+for f in $(seq 1 6); do
+    awk -v f=$f 'BEGIN { print "id,plate"; for (i = 1; i <= 50000; ++i) print f "_" i "," ((f == 1 && i == 49000) || (f == 6 && i == 10) ? "NEEDLE" : "P" i) }' \
+        > "$WORK/latedir/f$f.csv"
+done
+datasets=()
+for name in one dir late latedir; do
+    printf 'name = %s\npath = %s\nmode = all\n' "$name" "$WORK/$name" > "$WORK/$name.dataset"
+    datasets+=("$WORK/$name.dataset")
+done
+requests=()
+for dataset in one dir; do
+    requests+=("$dataset\tplate\tP7\tall\tndjson" "$dataset\tplate\tP7\tall\tcsv" "$dataset\tplate\tP1\tall\tndjson\tprefix"
+               "$dataset\tstate\ts3\tall\tndjson\texact\tignore-case" "$dataset\tplate\tnowhere\tall\tndjson"
+               "$dataset\tplate\tP49\tfirst\tndjson" "$dataset\tplate\tP49\tfirst-per-file\tndjson")
+done
+for dataset in late latedir; do
+    requests+=("$dataset\tplate\tNEEDLE\tfirst\tndjson" "$dataset\tplate\tNEEDLE\tall\tndjson" "$dataset\tplate\tNEEDLE\tfirst-per-file\tcsv")
+done
+
+startServer "$WORK/single.sock" "${datasets[@]}"
+declare -A expected
+for request in "${requests[@]}"; do expected[$request]="$(ask "$WORK/single.sock" "$request")"; done
+stopServers
+expectSame "single server's first match" '{"id":"99000","plate":"NEEDLE"}' "${expected["late\tplate\tNEEDLE\tfirst\tndjson"]}"
+expectSame "single server's first match in a directory" '{"id":"1_49000","plate":"NEEDLE"}' "${expected["latedir\tplate\tNEEDLE\tfirst\tndjson"]}"
+
+export CSV_RESULT_CACHE_DIR="$WORK/cache"
+for run in first restarted; do
+    startServer "$WORK/coordinator.sock" --local-workers=3 "${datasets[@]}"
+    for request in "${requests[@]}"; do
+        expectSame "$run coordinator: $request" "${expected[$request]}" "$(ask "$WORK/coordinator.sock" "$request")"
+    done
+    stopServers
+done
+expectSame "answers came from the shared cache" 1 "$(ls "$WORK/cache" | grep -c '\.res$' | awk '{ print ($1 > 0) }')"
+unset CSV_RESULT_CACHE_DIR
+
+# a worker that takes requests and never answers them
+python3 - "$WORK/stuck.sock" <<'PY' &
+import socket, sys, time
+server = socket.socket(socket.AF_UNIX)
+server.bind(sys.argv[1])
+server.listen(16)
+clients = []
+while True:
+    clients.append(server.accept()[0])
+PY
+SERVERS="$!"
+startServer "$WORK/single.sock" "${datasets[@]}"
+startServer "$WORK/coordinator.sock" --workers="$WORK/single.sock,$WORK/stuck.sock" --worker-timeout=1 "${datasets[@]}"
+expectSame "stuck worker" "Error: Worker $WORK/stuck.sock did not answer" "$(ask "$WORK/coordinator.sock" "one\tplate\tP7\tall\tndjson" | head -1)"
+
+finish
@@ -6,9 +6,60 @@ import time
 import pandas as pd
 from concurrent.futures import ProcessPoolExecutor, ThreadPoolExecutor, as_completed
 import subprocess
+import socket
 
 app = Flask(__name__)
 
+# Unix socket of the resident C++ SearchServer, the subprocess binaries are only used when it is not running.
+# A host:port address is a TCP server, such as a coordinator in front of shard servers.
+SEARCH_SERVER_SOCKET = os.environ.get('CSV_SEARCH_SOCKET', '/tmp/csvsearch.sock')
+
+def connect_search_server():
+    host, separator, port = SEARCH_SERVER_SOCKET.rpartition(':')
+    if separator and '/' not in SEARCH_SERVER_SOCKET:
+        # a wildcard host is where the server listens, it is reached on this machine
+        return socket.create_connection((host if host not in ('', '*', '0.0.0.0', '::') else 'localhost', int(port)))
+    client = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    client.connect(SEARCH_SERVER_SOCKET)
+    return client
+
+def send_search_server(line):
+    with connect_search_server() as client:
+        client.sendall(f"{line}\n".encode())
+        chunks = []
+        while True:
+            chunk = client.recv(65536)
+            if not chunk:
+                break
+            chunks.append(chunk)
+    return b''.join(chunks).decode()
+
+def query_search_server(dataset, search_header, search_term, match='exact', ignore_case=False):
+    # empty match mode keeps the dataset's default, rows come back as newline-delimited JSON
+    flags = 'ignore-case' if ignore_case else ''
+    return send_search_server(f"{dataset}\t{search_header}\t{search_term}\t\tndjson\t{match}\t{flags}")
+
+# A search the C++ side rejected or failed to run, carries its error text
+class CppSearchError(Exception):
+    pass
+
+# match is exact, prefix or contains; ignore_case folds ASCII letters
+def run_cpp_search(dataset, binary_prefix, algorithm, search_header, search_term, match='exact', ignore_case=False):
+    try:
+        output = query_search_server(dataset, search_header, search_term, match, ignore_case)
+    except OSError:
+        command = [f'../C++/{binary_prefix}Serial' if algorithm == 'serial' else f'../C++/{binary_prefix}Parallel', search_header, search_term, '--format=ndjson', f'--match={match}']
+        if ignore_case:
+            command.append('--ignore-case')
+        completed = subprocess.run(command, capture_output=True, text=True)
+        if completed.returncode != 0:
+            raise CppSearchError(completed.stderr.strip() or f"{command[0]} exited with status {completed.returncode}")
+        output = completed.stdout
+    if output.startswith('Error:'):
+        raise CppSearchError(output.strip())
+    # one JSON object per matching row
+    return [json.loads(line) for line in output.splitlines() if line.strip()]
+
 def parallel_search_in_single_csv(file_path, header_row, search_header, search_term, chunk_size=1000, max_workers=4):
     results = []
     chunk_iterator = pd.read_csv(file_path, header=header_row - 1, chunksize=chunk_size)
@@ -160,11 +211,13 @@ def run_cpp1():
         algorithm = data.get('algorithm', 'serial')
         search_header = data.get('search_header', '')
         search_term = data.get('search_term', '')
-        # Call the C++ executable using subprocess
-        command = ['../C++/Data1Serial', search_header, search_term] if algorithm == 'serial' else ['../C++/Data1Parallel', search_header, search_term]
-        result = subprocess.run(command, capture_output=True, text=True)
-        output = result.stdout
-        return jsonify({"message": output})
+        start_time = time.time()
+        match = data.get('match', 'exact')
+        ignore_case = data.get('ignore_case', 'false').lower() in ('1', 'true', 'yes')
+        results = run_cpp_search('data1', 'Data1', algorithm, search_header, search_term, match, ignore_case)
+        return jsonify({"result": results, "Time taken is": time.time() - start_time})
+    except CppSearchError as e:
+        return jsonify({"error": str(e)}), 400
     except Exception as e:
         return jsonify({"error": str(e)}), 500
     
@@ -175,9 +228,13 @@ def run_cpp2():
         algorithm = data.get('algorithm', 'serial')
         search_header = data.get('search_header', '')
         search_term = data.get('search_term', '')
-        command = ['../C++/Data2Serial', search_header, search_term] if algorithm == 'serial' else ['../C++/Data2Parallel', search_header, search_term]
-        result = subprocess.run(command, capture_output=True, text=True)
-        return jsonify({"message": result.stdout})
+        start_time = time.time()
+        match = data.get('match', 'exact')
+        ignore_case = data.get('ignore_case', 'false').lower() in ('1', 'true', 'yes')
+        results = run_cpp_search('data2', 'Data2', algorithm, search_header, search_term, match, ignore_case)
+        return jsonify({"result": results, "Time taken is": time.time() - start_time})
+    except CppSearchError as e:
+        return jsonify({"error": str(e)}), 400
     except Exception as e:
         return jsonify({"error": str(e)}), 500
     
@@ -188,9 +245,50 @@ def run_cpp3():
         algorithm = data.get('algorithm', 'serial')
         search_header = data.get('search_header', '')
         search_term = data.get('search_term', '')
-        command = ['../C++/Data3Serial', search_header, search_term] if algorithm == 'serial' else ['../C++/Data3Parallel', search_header, search_term]
-        result = subprocess.run(command, capture_output=True, text=True)
-        return jsonify({"message": result.stdout})
+        start_time = time.time()
+        match = data.get('match', 'exact')
+        ignore_case = data.get('ignore_case', 'false').lower() in ('1', 'true', 'yes')
+        results = run_cpp_search('data3', 'Data3', algorithm, search_header, search_term, match, ignore_case)
+        return jsonify({"result": results, "Time taken is": time.time() - start_time})
+    except CppSearchError as e:
+        return jsonify({"error": str(e)}), 400
+    except Exception as e:
+        return jsonify({"error": str(e)}), 500
+
+# Group-by runs inside the parallel binaries, only the aggregated groups come back
+@app.route('/cppGroupBy', methods=['GET'])
+def run_cpp_group_by():
+    try:
+        data = request.args
+        binaries = {'data2': '../C++/Data2Parallel', 'data3': '../C++/Data3Parallel'}
+        dataset = data.get('dataset', 'data3')
+        if dataset not in binaries:
+            return jsonify({"error": "Invalid dataset. Choose 'data2' or 'data3'."}), 400
+        command = [binaries[dataset], '--group-by', data.get('group_by', ''), '--format=ndjson']
+        if data.get('aggregates'):
+            command.append('--agg=' + data.get('aggregates'))
+        if data.get('filter'):
+            command.append('--filter=' + data.get('filter'))
+        start_time = time.time()
+        completed = subprocess.run(command, capture_output=True, text=True)
+        if completed.returncode != 0:
+            return jsonify({"error": completed.stderr.strip()}), 400
+        groups = [json.loads(line) for line in completed.stdout.splitlines() if line.strip()]
+        return jsonify({"result": groups, "Time taken is": time.time() - start_time})
+    except Exception as e:
+        return jsonify({"error": str(e)}), 500
+
+# Hit and miss counters of the SearchServer's result cache
+@app.route('/cppCacheStats', methods=['GET'])
+def cpp_cache_stats():
+    try:
+        counters = {}
+        for line in send_search_server('stats').splitlines():
+            name, _, value = line.partition(' ')
+            counters[name] = int(value)
+        return jsonify(counters)
+    except OSError:
+        return jsonify({"error": "The search server is not running"}), 503
     except Exception as e:
         return jsonify({"error": str(e)}), 500
 